@@ -31,8 +31,9 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#if defined(OPENMP)
 #include <parallel/algorithm>
-#include <omp.h>
+#endif
 #include <cassert>
 
 #include "parallel.h"
@@ -42,6 +43,7 @@
 #include "graph.h"
 #include "pvector.h"
 #include "timer.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -89,7 +91,35 @@ inline bool isSpace(char c) {
   }
 }
 
-_seq<char> mmapStringFromFile(const char *filename) {
+// Evicts the input files (fname and the .config, .adj and .idx files of a
+// binary graph) from the page cache so that the next read comes from disk.
+// posix_fadvise drops the file's clean pages without privileges; as root the
+// whole page cache is dropped as well, which also evicts what readahead of
+// other files brought in.
+void dropPageCache(const char* fname) {
+  const char* suffixes[] = {"", ".config", ".adj", ".idx"};
+  int dropped = 0;
+  for (const char* suffix : suffixes) {
+    std::string name = std::string(fname) + suffix;
+    int fd = open(name.c_str(), O_RDONLY);
+    if (fd == -1) continue;
+    fdatasync(fd);
+    if (posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0) dropped++;
+    close(fd);
+  }
+  bool all = false;
+  if (geteuid() == 0) {
+    sync();
+    FILE* f = fopen("/proc/sys/vm/drop_caches", "w");
+    if (f != NULL) { all = fputs("1", f) >= 0; all = (fclose(f) == 0) && all; }
+  }
+  std::cout << "page cache dropped for " << dropped << " input file(s)"
+            << (all ? " and system wide" : "") << std::endl;
+}
+
+// Maps the file privately: with writable, writes go to private copies of
+// the pages touched and never reach the file.
+_seq<char> mmapStringFromFile(const char *filename, bool writable = false) {
   struct stat sb;
   int fd = open(filename, O_RDONLY);
   if (fd == -1) {
@@ -104,7 +134,8 @@ _seq<char> mmapStringFromFile(const char *filename) {
     perror("not a file\n");
     exit(-1);
   }
-  char *p = static_cast<char*>(mmap(0, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+  int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+  char *p = static_cast<char*>(mmap(0, sb.st_size, prot, MAP_PRIVATE, fd, 0));
   if (p == MAP_FAILED) {
     perror("mmap");
     exit(-1);
@@ -146,14 +177,13 @@ _seq<char> readStringFromFile(char *fileName) {
 
 // parallel code for converting a string to words
 words stringToWords(char *Str, long n) {
-  {parallel_for (long i=0; i < n; i++)
-      if (isSpace(Str[i])) Str[i] = 0; }
+  {par_for(0, n, 0, [&] (long i) { if (isSpace(Str[i])) Str[i] = 0; }); }
 
   // mark start of words
   bool *FL = newA(bool,n);
   assert(FL != NULL && "Malloc failure\n");
   FL[0] = Str[0];
-  {parallel_for (long i=1; i < n; i++) FL[i] = Str[i] && !Str[i-1];}
+  {par_for(1, n, 0, [&] (long i) { FL[i] = Str[i] && !Str[i-1]; });}
 
   // offset for each start of word
   _seq<long> Off = sequence::packIndex<long>(FL, n);
@@ -164,25 +194,35 @@ words stringToWords(char *Str, long n) {
   // pointer to each start of word
   char **SA = newA(char*, m);
   assert(SA != NULL && "Malloc failure\n");
-  {parallel_for (long j=0; j < m; j++) SA[j] = Str+offsets[j];}
+  {par_for(0, m, 0, [&] (long j) { SA[j] = Str+offsets[j]; });}
 
   free(offsets); 
   return words(Str,n,SA,m);
 }
 
+/* sort used by the preprocess function defined below: libstdc++'s parallel
+   mode under OpenMP, the fork-join quickSort in the other builds */
+template <class E, class F>
+static void degreeSort(E* A, size_t n, F f) {
+#if defined(OPENMP)
+  __gnu_parallel::sort(A, A + n, f);
+#else
+  quickSort(A, (long) n, f);
+#endif
+}
+
 /* prefix sum used by the preprocess function defined below */
 static pvector<uintT> ParallelPrefixSum (const pvector<uintT> &degrees) {
   const size_t block_size = 1<<20;
   const size_t num_blocks = (degrees.size() + block_size - 1) / block_size;
   pvector<uintT> local_sums(num_blocks);
-  #pragma omp parallel for
-  for (size_t block=0; block < num_blocks; block++) {
+  par_for(0, num_blocks, 0, [&] (size_t block) {
     uintT lsum = 0;
     size_t block_end = std::min((block + 1) * block_size, degrees.size());
     for (size_t i=block * block_size; i < block_end; i++)
       lsum += degrees[i];
     local_sums[block] = lsum;
-  }
+  });
   pvector<uintT> bulk_prefix(num_blocks+1);
   uintT total = 0;
   for (size_t block=0; block < num_blocks; block++) {
@@ -191,15 +231,14 @@ static pvector<uintT> ParallelPrefixSum (const pvector<uintT> &degrees) {
   }
   bulk_prefix[num_blocks] = total;
   pvector<uintT> prefix(degrees.size() + 1);
-  #pragma omp parallel for
-  for (size_t block=0; block < num_blocks; block++) {
+  par_for(0, num_blocks, 0, [&] (size_t block) {
     uintT local_total = bulk_prefix[block];
     size_t block_end = std::min((block + 1) * block_size, degrees.size());
     for (size_t i=block * block_size; i < block_end; i++) {
       prefix[i] = local_total;
       local_total += degrees[i];
     }
-  }
+  });
   prefix[degrees.size()] = bulk_prefix[num_blocks];
   return prefix;
 }
@@ -208,15 +247,17 @@ template <class vertex>
 graph<vertex> readGraphFromFile(char* fname, bool isSymmetric, bool mmap) {
   Timer t;
   t.Start();
+  TRACE_SPAN("readGraphFromFile");
+  trace::phase ph("readGraph/read");
   words W;
   if (mmap) {
     _seq<char> S = mmapStringFromFile(fname);
     char *bytes = newA(char, S.n);
     assert(bytes != NULL && "Malloc failure\n");
     // Cannot mutate the graph unless we copy.
-    parallel_for(size_t i=0; i<S.n; i++) {
+    par_for(0, S.n, 0, [&] (size_t i) {
       bytes[i] = S.A[i];
-    }
+    });
     if (munmap(S.A, S.n) == -1) {
       perror("munmap");
       exit(-1);
@@ -227,6 +268,8 @@ graph<vertex> readGraphFromFile(char* fname, bool isSymmetric, bool mmap) {
     _seq<char> S = readStringFromFile(fname);
     W = stringToWords(S.A, S.n);
   }
+  MEM_TAG(W.Chars, "words");
+  MEM_TAG(W.Strings, "words/index");
 #ifndef WEIGHTED
   if (W.Strings[0] != (string) "AdjacencyGraph") {
 #else
@@ -248,32 +291,37 @@ graph<vertex> readGraphFromFile(char* fname, bool isSymmetric, bool mmap) {
     abort();
   }
 
+  ph.next("readGraph/parse");
   uintT* offsets = newA(uintT,n);
   assert(offsets != NULL && "Malloc failure\n");
+  MEM_TAG(offsets, "offsets");
 #ifndef WEIGHTED
   uintE* edges = newA(uintE,m);
 #else
   intE* edges = newA(intE,2*m);
 #endif
   assert(edges != NULL && "Malloc failure\n");
+  MEM_TAG(edges, "edges");
 
-  {parallel_for(long i=0; i < n; i++) offsets[i] = atol(W.Strings[i + 3]);}
-  {parallel_for(long i=0; i<m; i++) {
+  {par_for(0, n, 0, [&] (long i) { offsets[i] = atol(W.Strings[i + 3]); });}
+  {par_for(0, m, 0, [&] (long i) {
 #ifndef WEIGHTED
       edges[i] = atol(W.Strings[i+n+3]);
 #else
       edges[2*i] = atol(W.Strings[i+n+3]);
       edges[2*i+1] = atol(W.Strings[i+n+m+3]);
 #endif
-    }}
+    });}
     
   //W.del(); // to deal with performance bug in malloc
   W.del(); //The original code ^ commented this out
 
+  ph.next("readGraph/vertices");
   vertex* v = newA(vertex,n);
   assert(v != NULL && "Malloc failure\n");
+  MEM_TAG(v, "vertices");
 
-  {parallel_for (uintT i=0; i < n; i++) {
+  {par_for(0, n, 0, [&] (uintT i) {
     uintT o = offsets[i];
     uintT l = ((i == n-1) ? m : offsets[i+1])-offsets[i];
     v[i].setOutDegree(l);
@@ -282,19 +330,22 @@ graph<vertex> readGraphFromFile(char* fname, bool isSymmetric, bool mmap) {
 #else
     v[i].setOutNeighbors(edges+2*o);
 #endif
-  }}
+  });}
 
   if(!isSymmetric) {
+    ph.next("readGraph/transpose");
     uintT* tOffsets = newA(uintT,n);
     assert(tOffsets != NULL && "Malloc failure\n");
-    {parallel_for(long i=0;i<n;i++) tOffsets[i] = INT_T_MAX;}
+    MEM_TAG(tOffsets, "tOffsets");
+    {par_for(0, n, 0, [&] (long i) { tOffsets[i] = INT_T_MAX; });}
 #ifndef WEIGHTED
     intPair* temp = newA(intPair,m);
 #else
     intTriple* temp = newA(intTriple,m);
 #endif
     assert(temp != NULL && "Malloc failure\n");
-    {parallel_for(long i=0;i<n;i++){
+    MEM_TAG(temp, "temp");
+    {par_for(0, n, 0, [&] (long i) {
       uintT o = offsets[i];
       for(uintT j=0;j<v[i].getOutDegree();j++){
 #ifndef WEIGHTED
@@ -303,7 +354,7 @@ graph<vertex> readGraphFromFile(char* fname, bool isSymmetric, bool mmap) {
 	temp[o+j] = make_pair(v[i].getOutNeighbor(j),make_pair(i,v[i].getOutWeight(j)));
 #endif
       }
-      }}
+      });}
     free(offsets);
 
 #ifndef WEIGHTED
@@ -330,7 +381,8 @@ graph<vertex> readGraphFromFile(char* fname, bool isSymmetric, bool mmap) {
     inEdges[1] = temp[0].second.second;
 #endif
     assert(inEdges != NULL && "Malloc failure\n");
-    {parallel_for(long i=1;i<m;i++) {
+    MEM_TAG(inEdges, "inEdges");
+    {par_for(1, m, 0, [&] (long i) {
 #ifndef WEIGHTED
       inEdges[i] = temp[i].second;
 #else
@@ -340,7 +392,7 @@ graph<vertex> readGraphFromFile(char* fname, bool isSymmetric, bool mmap) {
       if(temp[i].first != temp[i-1].first) {
 	tOffsets[temp[i].first] = i;
       }
-      }}
+      });}
 
     free(temp);
 
@@ -348,7 +400,7 @@ graph<vertex> readGraphFromFile(char* fname, bool isSymmetric, bool mmap) {
     //offset to the right
     sequence::scanIBack(tOffsets,tOffsets,n,minF<uintT>(),(uintT)m);
 
-    {parallel_for(long i=0;i<n;i++){
+    {par_for(0, n, 0, [&] (long i) {
       uintT o = tOffsets[i];
       uintT l = ((i == n-1) ? m : tOffsets[i+1])-tOffsets[i];
       v[i].setInDegree(l);
@@ -357,24 +409,22 @@ graph<vertex> readGraphFromFile(char* fname, bool isSymmetric, bool mmap) {
 #else
       v[i].setInNeighbors(inEdges+2*o);
 #endif
-      }}
+      });}
 
     free(tOffsets);
     
+    ph.next("readGraph/dedup");
     #ifndef WEIGHTED
     /* Removing redundant edges and self-loops*/ 
     
     pvector<uintT> new_out_degrees(n);
     pvector<uintT> new_in_degrees(n);
-    uintE *n_out_start, *n_out_end; 
-    uintE *n_in_start, *n_in_end; 
-    #pragma omp parallel for private(n_out_start, n_out_end, n_in_start, n_in_end)
-    for (long i = 0; i < n; ++i)
+    par_for(0, n, 0, [&] (long i)
     {
-        n_out_start = v[i].getOutNeighbors();
-        n_out_end   = v[i+1].getOutNeighbors();
-        n_in_start  = v[i].getInNeighbors();
-        n_in_end    = v[i+1].getInNeighbors();
+        uintE* n_out_start = v[i].getOutNeighbors();
+        uintE* n_out_end   = v[i+1].getOutNeighbors();
+        uintE* n_in_start  = v[i].getInNeighbors();
+        uintE* n_in_end    = v[i+1].getInNeighbors();
         if (i == n-1)
         {
             n_out_end = v[0].getOutNeighbors() + m;
@@ -391,22 +441,21 @@ graph<vertex> readGraphFromFile(char* fname, bool isSymmetric, bool mmap) {
         new_end = std::unique(n_in_start, n_in_end);
         new_end = std::remove(n_in_start, new_end, i);
         new_in_degrees[i] = new_end - n_in_start;
-    }
+    });
 
     pvector<uintT> offsets     = ParallelPrefixSum(new_out_degrees);
     pvector<uintT> inv_offsets = ParallelPrefixSum(new_in_degrees);
     
-    long new_numEdges {0};
-    #pragma omp parallel for reduction(+ : new_numEdges)
-    for (long i = 0; i < n; ++i)
-        new_numEdges += new_out_degrees[i];
+    long new_numEdges = offsets[n];
     
     vertex* newV        = newA(vertex, n);
     uintE* new_outEdges = newA(uintE, new_numEdges);
     uintE* new_inEdges  = newA(uintE, new_numEdges);
+    MEM_TAG(newV, "newV");
+    MEM_TAG(new_outEdges, "new_outEdges");
+    MEM_TAG(new_inEdges, "new_inEdges");
 
-    #pragma omp parallel for schedule(dynamic, 64)
-    for (long i = 0; i < n; ++i)
+    par_for(0, n, 64, [&] (long i)
     {
         newV[i].setOutDegree(new_out_degrees[i]);
         newV[i].setOutNeighbors(new_outEdges + offsets[i]);
@@ -417,7 +466,9 @@ graph<vertex> readGraphFromFile(char* fname, bool isSymmetric, bool mmap) {
         newV[i].setInNeighbors(new_inEdges + inv_offsets[i]);
         for (uintE ngh = 0; ngh < new_in_degrees[i]; ++ngh)
             newV[i].setInNeighbor(ngh, v[i].getInNeighbor(ngh));
-    }
+    });
+    /* the graph before deduplication is no longer needed */
+    free(v); free(edges); free(inEdges);
     #endif
          
     Uncompressed_Mem<vertex>* mem = new Uncompressed_Mem<vertex>(newV,n,new_numEdges,new_outEdges,new_inEdges);
@@ -429,41 +480,40 @@ graph<vertex> readGraphFromFile(char* fname, bool isSymmetric, bool mmap) {
   else {
     free(offsets);
     
+    ph.next("readGraph/dedup");
     #ifndef WEIGHTED
     /* Removing redundant edges - out edges first*/ 
     
     pvector<uintT> new_out_degrees(n);
-    uintE *n_out_start, *n_out_end; 
-    #pragma omp parallel for private(n_out_start, n_out_end)
-    for (long i = 0; i < n; ++i)
+    par_for(0, n, 0, [&] (long i)
     {
-        n_out_start = v[i].getOutNeighbors();
-        n_out_end   = v[i+1].getOutNeighbors();
+        uintE* n_out_start = v[i].getOutNeighbors();
+        uintE* n_out_end   = v[i+1].getOutNeighbors();
         if (i == n-1) n_out_end = v[0].getOutNeighbors() + m;
         std::sort(n_out_start, n_out_end);
         uintE* new_end = std::unique(n_out_start, n_out_end);
         new_end = std::remove(n_out_start, new_end, i);
         new_out_degrees[i] = new_end - n_out_start;
-    }
+    });
 
     pvector<uintT> offsets     = ParallelPrefixSum(new_out_degrees);
     
-    long new_numEdges {0};
-    #pragma omp parallel for reduction(+ : new_numEdges)
-    for (long i = 0; i < n; ++i)
-        new_numEdges += new_out_degrees[i];
+    long new_numEdges = offsets[n];
     
     vertex* newV        = newA(vertex, n);
     uintE* new_outEdges = newA(uintE, new_numEdges);
+    MEM_TAG(newV, "newV");
+    MEM_TAG(new_outEdges, "new_outEdges");
 
-    #pragma omp parallel for schedule(dynamic, 64)
-    for (long i = 0; i < n; ++i)
+    par_for(0, n, 64, [&] (long i)
     {
         newV[i].setOutDegree(new_out_degrees[i]);
         newV[i].setOutNeighbors(new_outEdges + offsets[i]);
         for (uintE ngh = 0; ngh < new_out_degrees[i]; ++ngh)
             newV[i].setOutNeighbor(ngh, v[i].getOutNeighbor(ngh));
-    }
+    });
+    /* the graph before deduplication is no longer needed */
+    free(v); free(edges);
     #endif
 
     Uncompressed_Mem<vertex>* mem = new Uncompressed_Mem<vertex>(newV,n,new_numEdges,new_outEdges);
@@ -476,6 +526,7 @@ graph<vertex> readGraphFromFile(char* fname, bool isSymmetric, bool mmap) {
 
 template <class vertex>
 graph<vertex> readGraphFromBinary(char* iFile, bool isSymmetric) {
+  TRACE_SPAN("readGraphFromBinary");
   char* config = (char*) ".config";
   char* adj = (char*) ".adj";
   char* idx = (char*) ".idx";
@@ -504,7 +555,9 @@ graph<vertex> readGraphFromBinary(char* iFile, bool isSymmetric) {
 #else
   long m = size/sizeof(uint);
 #endif
-  char* s = (char *) malloc(size);
+  // allocate through newA so the serial read below does not place the whole
+  // edge array on the reading thread's node
+  char* s = newA(char, size);
   in2.read(s,size);
   in2.close();
   uintE* edges = (uintE*) s;
@@ -515,7 +568,7 @@ graph<vertex> readGraphFromBinary(char* iFile, bool isSymmetric) {
   in3.seekg(0);
   if(n != size/sizeof(intT)) { cout << "File size wrong\n"; abort(); }
 
-  char* t = (char *) malloc(size);
+  char* t = newA(char, size);
   in3.read(t,size);
   in3.close();
   uintT* offsets = (uintT*) t;
@@ -523,13 +576,13 @@ graph<vertex> readGraphFromBinary(char* iFile, bool isSymmetric) {
   vertex* v = newA(vertex,n);
 #ifdef WEIGHTED
   intE* edgesAndWeights = newA(intE,2*m);
-  {parallel_for(long i=0;i<m;i++) {
+  {par_for(0, m, 0, [&] (long i) {
     edgesAndWeights[2*i] = edges[i];
     edgesAndWeights[2*i+1] = edges[i+m];
-    }}
+    });}
   //free(edges);
 #endif
-  {parallel_for(long i=0;i<n;i++) {
+  {par_for(0, n, 0, [&] (long i) {
     uintT o = offsets[i];
     uintT l = ((i==n-1) ? m : offsets[i+1])-offsets[i];
       v[i].setOutDegree(l);
@@ -538,17 +591,17 @@ graph<vertex> readGraphFromBinary(char* iFile, bool isSymmetric) {
 #else
       v[i].setOutNeighbors(edgesAndWeights+2*o);
 #endif
-  }}
+  });}
 
   if(!isSymmetric) {
     uintT* tOffsets = newA(uintT,n);
-    {parallel_for(long i=0;i<n;i++) tOffsets[i] = INT_T_MAX;}
+    {par_for(0, n, 0, [&] (long i) { tOffsets[i] = INT_T_MAX; });}
 #ifndef WEIGHTED
     intPair* temp = newA(intPair,m);
 #else
     intTriple* temp = newA(intTriple,m);
 #endif
-    {parallel_for(intT i=0;i<n;i++){
+    {par_for(0, n, 0, [&] (intT i) {
       uintT o = offsets[i];
       for(uintT j=0;j<v[i].getOutDegree();j++){
 #ifndef WEIGHTED
@@ -557,7 +610,7 @@ graph<vertex> readGraphFromBinary(char* iFile, bool isSymmetric) {
 	temp[o+j] = make_pair(v[i].getOutNeighbor(j),make_pair(i,v[i].getOutWeight(j)));
 #endif
       }
-      }}
+      });}
     free(offsets);
 #ifndef WEIGHTED
 #ifndef LOWMEM
@@ -581,7 +634,7 @@ graph<vertex> readGraphFromBinary(char* iFile, bool isSymmetric) {
     inEdges[0] = temp[0].second.first;
     inEdges[1] = temp[0].second.second;
 #endif
-    {parallel_for(long i=1;i<m;i++) {
+    {par_for(1, m, 0, [&] (long i) {
 #ifndef WEIGHTED
       inEdges[i] = temp[i].second;
 #else
@@ -591,12 +644,12 @@ graph<vertex> readGraphFromBinary(char* iFile, bool isSymmetric) {
       if(temp[i].first != temp[i-1].first) {
 	tOffsets[temp[i].first] = i;
       }
-      }}
+      });}
     free(temp);
     //fill in offsets of degree 0 vertices by taking closest non-zero
     //offset to the right
     sequence::scanIBack(tOffsets,tOffsets,n,minF<uintT>(),(uintT)m);
-    {parallel_for(long i=0;i<n;i++){
+    {par_for(0, n, 0, [&] (long i) {
       uintT o = tOffsets[i];
       uintT l = ((i == n-1) ? m : tOffsets[i+1])-tOffsets[i];
       v[i].setInDegree(l);
@@ -605,7 +658,7 @@ graph<vertex> readGraphFromBinary(char* iFile, bool isSymmetric) {
 #else
       v[i].setInNeighbors((intE*)(inEdges+2*o));
 #endif
-      }}
+      });}
     free(tOffsets);
 #ifndef WEIGHTED
     Uncompressed_Mem<vertex>* mem = new Uncompressed_Mem<vertex>(v,n,m,edges,inEdges);
@@ -634,25 +687,21 @@ graph<vertex> readGraph(char* iFile, bool compressed, bool symmetric, bool binar
 template <class vertex>
 graph<vertex> readCompressedGraph(char* fname, bool isSymmetric, bool mmap) {
   char* s;
+  size_t mapped = 0;
   if (mmap) {
-    _seq<char> S = mmapStringFromFile(fname);
-    // Cannot mutate graph unless we copy.
-    char *bytes = newA(char, S.n);
-    parallel_for(size_t i=0; i<S.n; i++) {
-      bytes[i] = S.A[i];
-    }
-    if (munmap(S.A, S.n) == -1) {
-      perror("munmap");
-      exit(-1);
-    }
-    s = bytes;
+    // Zero-copy: the offsets, degrees and edges are read in place from a
+    // private mapping, paged in on first use. packOutNgh, which rewrites
+    // adjacency lists, only gets private copies of the pages it writes.
+    _seq<char> S = mmapStringFromFile(fname, true);
+    s = S.A;
+    mapped = S.n;
   } else {
     ifstream in(fname,ifstream::in |ios::binary);
     in.seekg(0,ios::end);
     long size = in.tellg();
     in.seekg(0);
     cout << "size = " << size << endl;
-    s = (char*) malloc(size);
+    s = newA(char, size);
     in.read(s,size);
     in.close();
   }
@@ -692,24 +741,24 @@ graph<vertex> readCompressedGraph(char* fname, bool isSymmetric, bool mmap) {
 
 
   vertex *V = newA(vertex,n);
-  parallel_for(long i=0;i<n;i++) {
+  par_for(0, n, 0, [&] (long i) {
     long o = offsets[i];
     uintT d = Degrees[i];
     V[i].setOutDegree(d);
     V[i].setOutNeighbors(edges+o);
-  }
+  });
 
   if(sizeof(vertex) == sizeof(compressedAsymmetricVertex)){
-    parallel_for(long i=0;i<n;i++) {
+    par_for(0, n, 0, [&] (long i) {
       long o = inOffsets[i];
       uintT d = inDegrees[i];
       V[i].setInDegree(d);
       V[i].setInNeighbors(inEdges+o);
-    }
+    });
   }
 
   cout << "creating graph..."<<endl;
-  Compressed_Mem<vertex>* mem = new Compressed_Mem<vertex>(V, s);
+  Compressed_Mem<vertex>* mem = new Compressed_Mem<vertex>(V, s, mapped);
 
   graph<vertex> G(V,n,m,mem);
   return G;
@@ -732,6 +781,8 @@ graph<vertex> preprocessGraph(graph<vertex> GA, bool isSym, bool useOutdeg,
 {
     Timer t; 
     t.Start();
+    TRACE_SPAN("preprocessGraph");
+    trace::phase ph("preprocess/degrees");
     auto numVertices = GA.n;
     auto numEdges    = GA.m;
     vertex *origG    = GA.V;
@@ -740,8 +791,7 @@ graph<vertex> preprocessGraph(graph<vertex> GA, bool isSym, bool useOutdeg,
     if (!isSym) {
         /* directed graph */
         /* STEP I - collect degrees of all vertices */
-        #pragma omp parallel for
-        for (uintE v = 0; v < numVertices; ++v) {
+        par_for(0, numVertices, 0, [&] (uintE v) {
             vertex vtx = origG[v];
             if (useOutdeg) {
                 degree_id_pairs[v] = std::make_pair(vtx.getOutDegree(), v);
@@ -749,17 +799,18 @@ graph<vertex> preprocessGraph(graph<vertex> GA, bool isSym, bool useOutdeg,
             else {
                 degree_id_pairs[v] = std::make_pair(vtx.getInDegree(), v);
             }
-        }
+        });
 
         /* Step II - sort the degrees in parallel */
-        __gnu_parallel::sort(degree_id_pairs.begin(), degree_id_pairs.end(), 
-                             std::greater<degree_nodeid_t>());
+        ph.next("preprocess/sort");
+        degreeSort(degree_id_pairs.begin(), degree_id_pairs.size(),
+                   std::greater<degree_nodeid_t>());
 
         /* Step III - make a remap based on the sorted degree list */
+        ph.next("preprocess/remap");
         pvector<uintT> degrees(numVertices);
         pvector<uintT> inv_degrees(numVertices);
-        #pragma omp parallel for
-        for (uintE v = 0; v < numVertices; ++v) {
+        par_for(0, numVertices, 0, [&] (uintE v) {
             degrees[v] = degree_id_pairs[v].first;
             auto origID = degree_id_pairs[v].second;
             new_ids[origID] = v;
@@ -770,11 +821,12 @@ graph<vertex> preprocessGraph(graph<vertex> GA, bool isSym, bool useOutdeg,
             else {
                 inv_degrees[v] = vtx.getOutDegree();
             }
-        }
+        });
         //clearing space from degree pairs
         pvector<degree_nodeid_t>().swap(degree_id_pairs);
 
         /* Step IV - make a new vertex list for the new graph */
+        ph.next("preprocess/relabel");
 		pvector<uintT> offsets     = ParallelPrefixSum(degrees);
 		pvector<uintT> inv_offsets = ParallelPrefixSum(inv_degrees);
         //clearing space from degree lists
@@ -788,8 +840,7 @@ graph<vertex> preprocessGraph(graph<vertex> GA, bool isSym, bool useOutdeg,
             intE* inEdges  = newA(intE, 2 * numEdges);
         #endif
         vertex* newV    = newA(vertex, numVertices);
-        #pragma omp parallel for schedule (dynamic, 1024)
-        for (uintE v = 0; v < numVertices; ++v) {
+        par_for(0, numVertices, 1024, [&] (uintE v) {
             /* note that vertex IDs u and v belong to the space of original vertex IDs */
             //copy out-neighbors
             auto newID = new_ids[v];
@@ -867,7 +918,7 @@ graph<vertex> preprocessGraph(graph<vertex> GA, bool isSym, bool useOutdeg,
                    ++endNgh; 
                 std::sort(startNgh, endNgh);
             }
-        }
+        });
 
         /* Step V - make the new graph */ 
         Uncompressed_Mem<vertex>* mem = new Uncompressed_Mem<vertex>(newV,numVertices,numEdges,outEdges,inEdges);
@@ -878,28 +929,29 @@ graph<vertex> preprocessGraph(graph<vertex> GA, bool isSym, bool useOutdeg,
     else {
         /* undirected graph */
         /* STEP I - collect degrees of all vertices */
-        #pragma omp parallel for
-        for (uintE v = 0; v < numVertices; ++v) {
+        par_for(0, numVertices, 0, [&] (uintE v) {
             vertex vtx = origG[v];
             degree_id_pairs[v] = std::make_pair(vtx.getOutDegree(), v);
-        }
+        });
 
         /* Step II - sort the degrees in parallel */
-        __gnu_parallel::sort(degree_id_pairs.begin(), degree_id_pairs.end(), 
-                             std::greater<degree_nodeid_t>());
+        ph.next("preprocess/sort");
+        degreeSort(degree_id_pairs.begin(), degree_id_pairs.size(),
+                   std::greater<degree_nodeid_t>());
 
         /* Step III - make a remap based on the sorted degree list */
+        ph.next("preprocess/remap");
         pvector<uintT> degrees(numVertices);
-        #pragma omp parallel for
-        for (uintE v = 0; v < numVertices; ++v) {
+        par_for(0, numVertices, 0, [&] (uintE v) {
             degrees[v] = degree_id_pairs[v].first;
             auto origID = degree_id_pairs[v].second;
             new_ids[origID] = v;
-        }
+        });
         //clearing space from degree pairs
         pvector<degree_nodeid_t>().swap(degree_id_pairs);
 
         /* Step IV - make a new vertex list for the new graph */
+        ph.next("preprocess/relabel");
 		pvector<uintT> offsets     = ParallelPrefixSum(degrees);
         //clearing space from degrees
         pvector<uintT>().swap(degrees);
@@ -909,8 +961,7 @@ graph<vertex> preprocessGraph(graph<vertex> GA, bool isSym, bool useOutdeg,
             intE* outEdges = newA(intE, 2 * numEdges);
         #endif
         vertex* newV    = newA(vertex, numVertices);
-        #pragma omp parallel for schedule (dynamic, 1024)
-        for (uintE v = 0; v < numVertices; ++v) {
+        par_for(0, numVertices, 1024, [&] (uintE v) {
             /* note that vertex IDs u and v belong to the space of original vertex IDs */
             //copy neighbors
             auto newID = new_ids[v];
@@ -933,7 +984,7 @@ graph<vertex> preprocessGraph(graph<vertex> GA, bool isSym, bool useOutdeg,
             for (int i = 0; i < origG[v].getOutDegree(); ++i)
                ++endNgh; 
             std::sort(startNgh, endNgh);
-        }
+        });
 
         /* Step V - make the new graph */ 
         Uncompressed_Mem<vertex>* mem = new Uncompressed_Mem<vertex>(newV,numVertices,numEdges,outEdges);
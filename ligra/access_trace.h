@@ -0,0 +1,216 @@
+#ifndef ACCESS_TRACE_H
+#define ACCESS_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// **************************************************************
+//    MEMORY ACCESS TRACE (ACCESS_TRACE)
+// **************************************************************
+
+// Compiled with ACCESS_TRACE, the push kernels record the accesses they make
+// to the graph and to the property arrays: decodeOutNgh and
+// decodeOutNghSparse read the out-edge of every neighbor they visit, the
+// apps' updateAtomic functions note their property reads and writes with
+// ACCESS_READ and ACCESS_WRITE, and every CAS attempt (CAS, writeMin,
+// writeAdd, writeOr) is an atomic write. An access is stored as the array it
+// falls in and the element index; arrays are registered with
+// ACCESS_TRACE_ARRAY (the apps) or name_array (the graph, in runRounds), and
+// addresses outside of them are stored under array 255 with the address as
+// index.
+//
+// With -access_trace <file> the rounds are traced to file; -access_period p
+// and -access_window w keep the first w of every p accesses of each thread
+// (1 and 1 record everything). Each thread fills its own buffer of
+// buffer_records records and appends it to the file when full, so the
+// records of a thread are in order and the threads' blocks interleave.
+// The file is
+//
+//   file_header, records..., array_entry[header.arrays]
+//
+// and utils/accessTraceReader prints, filters and converts it. Without
+// ACCESS_TRACE the macros are empty.
+
+namespace access_trace {
+
+  const char magic[8] = {'L', 'I', 'G', 'R', 'A', 'A', 'C', 'C'};
+  const uint32_t version = 1;
+  const int max_arrays = 255;
+  const uint8_t unknown_array = 255;
+
+  enum flag { READ = 0, WRITE = 1, ATOMIC = 2 };
+
+  // seq is the number of accesses the thread made before this one, sampled
+  // or not, so a reader can interleave the threads approximately.
+  struct record {
+    uint64_t index;
+    uint64_t meta;  // seq << 24 | thread << 16 | array << 8 | flags
+    uint64_t seq() const { return meta >> 24; }
+    int thread() const { return (meta >> 16) & 0xff; }
+    int array() const { return (meta >> 8) & 0xff; }
+    int flags() const { return meta & 0xff; }
+  };
+
+  struct file_header {
+    char magic[8];
+    uint32_t version, record_size;
+    uint64_t period, window;
+    uint64_t records;          // filled in when the file is closed
+    uint64_t arrays_offset;    // byte offset of the array table
+    uint32_t arrays, threads;
+  };
+
+  struct array_entry {
+    char name[48];
+    uint64_t base, elt, n;
+  };
+
+  const size_t buffer_records = 1 << 16;
+
+  struct buffer {
+    int thread;
+    uint64_t seq;
+    size_t n;
+    record r[buffer_records];
+  };
+
+  struct state {
+    bool on;
+    FILE* f;
+    uint64_t period, window, records;
+    std::mutex m;
+    std::vector<array_entry> arrays;
+    std::vector<buffer*> buffers;
+  };
+
+  inline state& current() {
+    static state s;
+    return s;
+  }
+
+  inline bool enabled() { return current().on; }
+
+  inline void flush(buffer& b) {
+    state& s = current();
+    std::lock_guard<std::mutex> lk(s.m);
+    if (s.f != NULL && b.n > 0) {
+      fwrite(b.r, sizeof(record), b.n, s.f);
+      s.records += b.n;
+    }
+    b.n = 0;
+  }
+
+  inline buffer& local() {
+    static thread_local buffer* mine = NULL;
+    if (mine == NULL) {
+      state& s = current();
+      std::lock_guard<std::mutex> lk(s.m);
+      mine = new buffer();
+      mine->thread = s.buffers.size() & 0xff;
+      s.buffers.push_back(mine);
+    }
+    return *mine;
+  }
+
+  // Names the n elements of size elt at p; replaces an array of the same
+  // name, keeping its id.
+  inline void name_array(const void* p, long n, size_t elt, const char* name) {
+    state& s = current();
+    std::lock_guard<std::mutex> lk(s.m);
+    array_entry e;
+    memset(&e, 0, sizeof(e));
+    strncpy(e.name, name, sizeof(e.name) - 1);
+    e.base = (uintptr_t) p; e.elt = elt; e.n = n;
+    for (array_entry& a : s.arrays)
+      if (strcmp(a.name, e.name) == 0) { a = e; return; }
+    if ((int) s.arrays.size() < max_arrays) s.arrays.push_back(e);
+  }
+
+  inline void lookup(uintptr_t addr, uint8_t& array, uint64_t& index) {
+    const std::vector<array_entry>& a = current().arrays;
+    for (size_t i = 0; i < a.size(); i++)
+      if (addr >= a[i].base && addr < a[i].base + a[i].n * a[i].elt) {
+        array = i; index = (addr - a[i].base) / a[i].elt;
+        return;
+      }
+    array = unknown_array; index = addr;
+  }
+
+  inline void access(const volatile void* p, int flags) {
+    if (!enabled()) return;
+    buffer& b = local();
+    uint64_t seq = b.seq++;
+    state& s = current();
+    if (seq % s.period >= s.window) return;
+    uint8_t array; uint64_t index;
+    lookup((uintptr_t) p, array, index);
+    b.r[b.n].index = index;
+    b.r[b.n].meta = seq << 24 | (uint64_t) b.thread << 16 | (uint64_t) array << 8 | flags;
+    if (++b.n == buffer_records) flush(b);
+  }
+
+  // Flushes the buffers and writes the array table; called at exit.
+  inline void close() {
+    state& s = current();
+    if (s.f == NULL) return;
+    s.on = false;
+    for (buffer* b : s.buffers) flush(*b);
+    std::lock_guard<std::mutex> lk(s.m);
+    file_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, magic, sizeof(magic));
+    h.version = version; h.record_size = sizeof(record);
+    h.period = s.period; h.window = s.window;
+    h.records = s.records;
+    h.arrays_offset = ftell(s.f);
+    h.arrays = s.arrays.size(); h.threads = s.buffers.size();
+    fwrite(s.arrays.data(), sizeof(array_entry), s.arrays.size(), s.f);
+    fseek(s.f, 0, SEEK_SET);
+    fwrite(&h, sizeof(h), 1, s.f);
+    fclose(s.f);
+    s.f = NULL;
+    printf("access trace: %lu records of %zu thread(s)\n", (unsigned long) h.records,
+           s.buffers.size());
+  }
+
+  // Opens the trace file; an empty name leaves tracing off. start() turns
+  // recording on.
+  inline void open(const std::string& filename, long period, long window) {
+    if (filename == "") return;
+    state& s = current();
+    s.f = fopen(filename.c_str(), "wb");
+    if (s.f == NULL) { perror(filename.c_str()); return; }
+    s.period = std::max(1L, period);
+    s.window = std::max(1L, std::min(window, (long) s.period));
+    file_header h;
+    memset(&h, 0, sizeof(h));
+    fwrite(&h, sizeof(h), 1, s.f);
+    atexit(close);
+  }
+
+  inline void start() {
+    if (current().f == NULL) return;
+    local();  // the main thread is thread 0
+    current().on = true;
+  }
+}
+
+#ifdef ACCESS_TRACE
+#define ACCESS_READ(p) access_trace::access((p), access_trace::READ)
+#define ACCESS_WRITE(p) access_trace::access((p), access_trace::WRITE)
+#define ACCESS_ATOMIC(p) access_trace::access((p), access_trace::WRITE | access_trace::ATOMIC)
+#define ACCESS_TRACE_ARRAY(a, n) access_trace::name_array((a), (n), sizeof(*(a)), #a)
+#else
+#define ACCESS_READ(p)
+#define ACCESS_WRITE(p)
+#define ACCESS_ATOMIC(p)
+#define ACCESS_TRACE_ARRAY(a, n)
+#endif
+
+#endif
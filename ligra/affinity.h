@@ -0,0 +1,257 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "parallel.h"
+#include "allocator.h"
+
+// **************************************************************
+//    THREAD PLACEMENT
+// **************************************************************
+
+// -pin compact|scatter pins worker i to the i-th cpu of an ordering built
+// from the sysfs topology:
+//
+//   compact - fills one NUMA node after the other, core by core, with the
+//             hardware threads of a core next to each other.
+//   scatter - takes the nodes round-robin, and within a node uses every
+//             core once before using a second hardware thread of any core.
+//
+// With -physical only the first hardware thread of every core is used and
+// the number of workers is set to the number of cores. Only cpus in the
+// process's affinity mask (taskset, cgroups) are used. Pinned threads record
+// their node, which localV() and node_par_for read.
+
+namespace affinity {
+
+  struct cpuInfo { int cpu, slot, package, core, smt; };
+
+  inline int readTopologyInt(int cpu, const char* file) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, file);
+    FILE* f = fopen(path, "r");
+    int v = 0;
+    if (f != NULL) {
+      if (fscanf(f, "%d", &v) != 1) v = 0;
+      fclose(f);
+    }
+    return v;
+  }
+
+  // The cpus this process may run on, with their node, package, core and
+  // index among the hardware threads of their core.
+  inline std::vector<cpuInfo> topology() {
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) != 0)
+      for (int c = 0; c < CPU_SETSIZE; c++) CPU_SET(c, &mask);
+    std::vector<int> online = numa::readCpuList("/sys/devices/system/cpu/online");
+    if (online.empty())
+      for (int c = 0; c < sysconf(_SC_NPROCESSORS_ONLN); c++) online.push_back(c);
+    const std::vector<int>& slots = numa::cpuSlots();
+    std::vector<cpuInfo> r;
+    char path[128];
+    for (int cpu : online) {
+      if (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &mask)) continue;
+      cpuInfo c;
+      c.cpu = cpu;
+      c.slot = (cpu < (int) slots.size()) ? slots[cpu] : 0;
+      c.package = readTopologyInt(cpu, "physical_package_id");
+      c.core = readTopologyInt(cpu, "core_id");
+      snprintf(path, sizeof(path),
+               "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+      std::vector<int> siblings = numa::readCpuList(path);
+      c.smt = std::find(siblings.begin(), siblings.end(), cpu) - siblings.begin();
+      if (c.smt == (int) siblings.size()) c.smt = 0;
+      r.push_back(c);
+    }
+    return r;
+  }
+
+  inline std::vector<cpuInfo> order(std::vector<cpuInfo> cpus, bool scatter, bool physical) {
+    if (physical)
+      cpus.erase(std::remove_if(cpus.begin(), cpus.end(),
+                                [] (const cpuInfo& c) { return c.smt > 0; }),
+                 cpus.end());
+    auto key = [scatter] (const cpuInfo& c) {
+      return scatter ? std::make_tuple(c.slot, c.smt, c.package, c.core, c.cpu)
+                     : std::make_tuple(c.slot, c.package, c.core, c.smt, c.cpu);
+    };
+    std::sort(cpus.begin(), cpus.end(),
+              [&] (const cpuInfo& a, const cpuInfo& b) { return key(a) < key(b); });
+    if (!scatter) return cpus;
+    // deal the per node lists out round-robin
+    int k = numa::numNodes();
+    std::vector<std::vector<cpuInfo> > perNode(k);
+    for (const cpuInfo& c : cpus) perNode[c.slot % k].push_back(c);
+    std::vector<cpuInfo> r;
+    for (size_t i = 0; r.size() < cpus.size(); i++)
+      for (int s = 0; s < k; s++)
+        if (i < perNode[s].size()) r.push_back(perNode[s][i]);
+    return r;
+  }
+
+  // cpu and node slot of worker i are workerCpus()[i % size]
+  inline std::vector<cpuInfo>& workerCpus() {
+    static std::vector<cpuInfo> w;
+    return w;
+  }
+
+  inline bool pinned() { return !workerCpus().empty(); }
+
+  // Pins the calling thread as worker i.
+  inline void pinThread(int i) {
+    const std::vector<cpuInfo>& w = workerCpus();
+    if (w.empty()) return;
+    const cpuInfo& c = w[i % w.size()];
+    cpu_set_t s;
+    CPU_ZERO(&s);
+    CPU_SET(c.cpu, &s);
+    if (sched_setaffinity(0, sizeof(s), &s) != 0) perror("sched_setaffinity");
+    numa::cachedSlot() = c.slot;
+  }
+
+  inline void pinWorkers() {
+#if defined(CILK) || defined(CILKP)
+    std::cout << "-pin: Cilk workers cannot be pinned, pinning the main thread only"
+              << std::endl;
+    pinThread(0);
+#elif defined(OPENMP)
+    #pragma omp parallel
+    pinThread(omp_get_thread_num());
+#elif defined(HOMEGROWN)
+    // restarts the workers, which pin themselves as they start
+    ligra_ws::on_worker_start() = pinThread;
+    ligra_ws::set_num_workers(getWorkers(), true);
+#else
+    pinThread(0);
+#endif
+  }
+
+  // Sets up pinning from the -pin and -physical options and reports the
+  // topology and the worker to cpu map. An empty mode leaves threads alone.
+  inline void pin(const std::string& mode, bool physical) {
+    if (mode == "") return;
+    if (mode != "compact" && mode != "scatter") {
+      std::cout << "unknown -pin mode " << mode << ", threads are not pinned" << std::endl;
+      return;
+    }
+    std::vector<cpuInfo> cpus = topology();
+    std::vector<cpuInfo> w = order(cpus, mode == "scatter", physical);
+    if (w.empty()) {
+      std::cout << "-pin: no usable cpus, threads are not pinned" << std::endl;
+      return;
+    }
+    std::vector<std::pair<int,int> > cores;
+    std::vector<int> packages;
+    for (const cpuInfo& c : cpus) {
+      cores.push_back(std::make_pair(c.package, c.core));
+      packages.push_back(c.package);
+    }
+    std::sort(cores.begin(), cores.end());
+    std::sort(packages.begin(), packages.end());
+    long numCores = std::unique(cores.begin(), cores.end()) - cores.begin();
+    long numPackages = std::unique(packages.begin(), packages.end()) - packages.begin();
+    std::cout << "Topology: " << numa::numNodes() << " node(s), " << numPackages
+              << " package(s), " << numCores << " core(s), " << cpus.size()
+              << " hw thread(s) available" << std::endl;
+
+    workerCpus() = w;
+    if (physical) setWorkers(w.size());
+    int p = getWorkers();
+    std::cout << "Pinning " << p << " worker(s) " << mode
+              << (physical ? " on physical cores" : "") << ", worker:cpu(node)";
+    for (int i = 0; i < p; i++) {
+      const cpuInfo& c = w[i % w.size()];
+      std::cout << " " << i << ":" << c.cpu << "(" << numa::memoryNodes()[c.slot] << ")";
+    }
+    std::cout << std::endl;
+    if (p > (int) w.size())
+      std::cout << "-pin: more workers than cpus, cpus are shared" << std::endl;
+    pinWorkers();
+  }
+
+  // Calls f(i) for i in [0, n). With -numa partition and pinned threads,
+  // the range is cut into one range per node, range s running from cut(s)
+  // to cut(s+1) (cut is called for 0 < s < k only), and the threads of each
+  // node first take grain sized chunks of their own node's range, then help
+  // with the other ranges. Otherwise it is par_for. Under HOMEGROWN the
+  // loop is one task per worker; a worker that runs several just helps.
+  template <class F, class C>
+  inline void node_par_for_cut(long n, long grain, F f, C cut) {
+#if defined(OPENMP) || defined(HOMEGROWN)
+    int k = numa::numNodes();
+    if (k > 1 && pinned() && numa::policy() == ALLOC_PARTITION) {
+      struct alignas(64) cursor { std::atomic<long> next; long end; };
+      std::vector<cursor> c(k);
+      std::vector<long> bounds(k + 1);
+      bounds[0] = 0; bounds[k] = n;
+      for (int s = 1; s < k; s++) bounds[s] = std::max(bounds[s-1], std::min(n, cut(s, k)));
+      for (int s = 0; s < k; s++) {
+        c[s].next.store(bounds[s]);
+        c[s].end = bounds[s+1];
+      }
+      auto drain = [&] () {
+        int home = numa::localSlot();
+        for (int d = 0; d < k; d++) {
+          int s = (home + d) % k;
+          long end = c[s].end;
+          long i;
+          while ((i = c[s].next.fetch_add(grain)) < end)
+            for (long j = i; j < std::min(i + grain, end); j++) f(j);
+        }
+      };
+#if defined(OPENMP)
+      #pragma omp parallel
+      drain();
+#else
+      par_for(0, getWorkers(), 1, [&] (long) { drain(); });
+#endif
+      return;
+    }
+#endif
+    par_for(0, n, grain, f);
+  }
+
+  // node_par_for over a range cut like the partitioned property arrays:
+  // node s gets the vertices [n*s/k, n*(s+1)/k).
+  template <class F>
+  inline void node_par_for(long n, long grain, F f) {
+    node_par_for_cut(n, grain, f, [&] (int s, int k) { return n * s / k; });
+  }
+
+  // The first vertex of range s of k when the vertices [0, n) are cut where
+  // placeArray cuts their edge array: pos(v) is the address of v's edges,
+  // which grows with v, and range s starts at the first vertex whose edges
+  // start at least s/k of the way into the array.
+  template <class P>
+  inline long edgeCut(long n, int s, int k, P pos) {
+    if (n == 0) return 0;
+    uintptr_t first = pos(0), last = pos(n - 1);
+    uintptr_t target = first + (last - first) / k * s;
+    long lo = 0, hi = n;
+    while (lo < hi) {
+      long mid = lo + (hi - lo) / 2;
+      if (pos(mid) < target) lo = mid + 1;
+      else hi = mid;
+    }
+    return lo;
+  }
+
+  // node_par_for over the vertices [0, n) cut like their partitioned edge
+  // array, so the threads of a node traverse the edges stored on it.
+  template <class F, class P>
+  inline void node_par_for(long n, long grain, F f, P pos) {
+    node_par_for_cut(n, grain, f, [&] (int s, int k) { return edgeCut(n, s, k, pos); });
+  }
+}
+
+#endif
@@ -0,0 +1,289 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "parallel.h"
+#include "mem_stats.h"
+
+// **************************************************************
+//    PLACEMENT OF LARGE ARRAYS
+// **************************************************************
+
+// newA, pvector and pbbs::new_array allocate through allocArray. Arrays of at
+// least placeMinBytes get a page-aligned block whose pages are bound to NUMA
+// nodes before anything touches them, according to the policy set with -numa:
+//
+//   interleave - pages are spread round-robin over all memory nodes.
+//   partition  - the array is cut by bytes into one contiguous range per
+//                node and range k is placed on node k. A property array is
+//                thus split into equal vertex ranges, and an edge array into
+//                equal edge counts. With pinned threads, the dense edgeMap
+//                loops hand each node the vertices whose edges were placed
+//                on it (see affinity::edgeCut), and other vertex loops
+//                through node_par_for the equal vertex ranges.
+//
+// With -hugepages, arrays of at least hugeMinBytes are additionally 2MB
+// aligned, advised with MADV_HUGEPAGE and prefaulted in parallel, so that
+// random updates into property arrays and scans of the edge arrays run on
+// transparent huge pages. MAP_HUGETLB is not used: it needs mmap/munmap,
+// while every caller releases these arrays with free().
+//
+// The memory is returned by posix_memalign, so callers keep using free().
+
+enum allocPolicy { ALLOC_DEFAULT, ALLOC_INTERLEAVE, ALLOC_PARTITION };
+
+namespace numa {
+
+  // Arrays smaller than this are not worth a page-aligned block.
+  const size_t placeMinBytes = 1 << 20;
+
+  inline size_t pageSize() {
+    static size_t ps = sysconf(_SC_PAGESIZE);
+    return ps;
+  }
+
+  // Ids of the online nodes that have memory, read from sysfs. Machines
+  // without /sys/devices/system/node report a single node 0.
+  inline const std::vector<int>& memoryNodes() {
+    static std::vector<int> nodes = [] {
+      std::vector<int> r;
+      char path[128];
+      for (int node = 0; node < 1024; node++) {
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/node/node%d/meminfo", node);
+        if (access(path, R_OK) == 0) r.push_back(node);
+      }
+      if (r.empty()) r.push_back(0);
+      return r;
+    }();
+    return nodes;
+  }
+
+  inline int numNodes() { return memoryNodes().size(); }
+
+  inline allocPolicy& policy() {
+    static allocPolicy p = ALLOC_DEFAULT;
+    return p;
+  }
+
+  inline const char* policyName(allocPolicy p) {
+    switch (p) {
+    case ALLOC_INTERLEAVE: return "interleave";
+    case ALLOC_PARTITION: return "partition";
+    default: return "default";
+    }
+  }
+
+  // Sets the policy from the -numa argument. Unknown names keep the default.
+  inline void setPolicy(const std::string& name) {
+    if (name == "interleave") policy() = ALLOC_INTERLEAVE;
+    else if (name == "partition") policy() = ALLOC_PARTITION;
+    else {
+      if (name != "" && name != "default")
+        fprintf(stderr, "unknown -numa policy %s, using default\n", name.c_str());
+      policy() = ALLOC_DEFAULT;
+    }
+    if (policy() != ALLOC_DEFAULT)
+      printf("NUMA placement: %s over %d node(s)\n", policyName(policy()), numNodes());
+  }
+
+  // mbind without a libnuma dependency. MPOL_MF_MOVE also migrates pages
+  // that malloc recycled from earlier arrays and that are already resident.
+  // bindRange gives up on placement for the rest of the run on failure.
+  inline long mbind(void* start, size_t len, int mode, const std::vector<int>& nodes) {
+    const size_t bits = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> mask(memoryNodes().back() / bits + 1, 0UL);
+    for (int node : nodes) mask[node / bits] |= 1UL << (node % bits);
+    return syscall(__NR_mbind, start, len, mode, mask.data(),
+                   (unsigned long) (mask.size() * bits + 1), MPOL_MF_MOVE);
+  }
+
+  inline bool bindRange(void* start, size_t len, int mode, const std::vector<int>& nodes) {
+    if (mbind(start, len, mode, nodes) != 0) {
+      perror("mbind, falling back to default placement");
+      policy() = ALLOC_DEFAULT;
+      return false;
+    }
+    return true;
+  }
+
+  // Cpus of a sysfs cpu list file such as "0-3,8-11"; empty if unreadable.
+  inline std::vector<int> readCpuList(const char* path) {
+    std::vector<int> r;
+    FILE* f = fopen(path, "r");
+    if (f == NULL) return r;
+    int lo, hi;
+    while (fscanf(f, "%d", &lo) == 1) {
+      hi = lo;
+      int c = fgetc(f);
+      if (c == '-') { if (fscanf(f, "%d", &hi) != 1) break; c = fgetc(f); }
+      for (int cpu = lo; cpu <= hi; cpu++) r.push_back(cpu);
+      if (c != ',') break;
+    }
+    fclose(f);
+    return r;
+  }
+
+  // Memory node slot (index into memoryNodes()) of every cpu, from the
+  // cpulist files in sysfs. Cpus not listed map to slot 0.
+  inline const std::vector<int>& cpuSlots() {
+    static std::vector<int> slots = [] {
+      std::vector<int> r(sysconf(_SC_NPROCESSORS_CONF), 0);
+      const std::vector<int>& nodes = memoryNodes();
+      char path[128];
+      for (size_t k = 0; k < nodes.size(); k++) {
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/node/node%d/cpulist", nodes[k]);
+        for (int cpu : readCpuList(path)) {
+          if (cpu >= (int) r.size()) r.resize(cpu + 1, 0);
+          r[cpu] = k;
+        }
+      }
+      return r;
+    }();
+    return slots;
+  }
+
+  // Per thread cache of localSlot(), set directly when a thread is pinned.
+  inline int& cachedSlot() {
+    static thread_local int slot = -1;
+    return slot;
+  }
+
+  // Memory node slot of the cpu the calling thread is running on, looked up
+  // on the thread's first call; threads are assumed to stay on their node,
+  // which -pin guarantees.
+  inline int localSlot() {
+    int& slot = cachedSlot();
+    if (slot < 0) {
+      int cpu = sched_getcpu();
+      const std::vector<int>& slots = cpuSlots();
+      slot = (cpu < 0 || cpu >= (int) slots.size()) ? 0 : slots[cpu];
+    }
+    return slot;
+  }
+
+  // Applies the current policy to the whole pages of [p, p+bytes).
+  inline void placeArray(void* p, size_t bytes) {
+    allocPolicy pol = policy();
+    if (pol == ALLOC_DEFAULT || numNodes() < 2) return;
+    size_t ps = pageSize();
+    uintptr_t s = ((uintptr_t) p + ps - 1) / ps * ps;
+    uintptr_t e = ((uintptr_t) p + bytes) / ps * ps;
+    if (e <= s) return;
+    const std::vector<int>& nodes = memoryNodes();
+    if (pol == ALLOC_INTERLEAVE) {
+      bindRange((void*) s, e - s, MPOL_INTERLEAVE, nodes);
+    } else {
+      size_t k = nodes.size();
+      size_t pages = (e - s) / ps;
+      for (size_t i = 0; i < k; i++) {
+        uintptr_t rs = s + (pages * i / k) * ps;
+        uintptr_t re = s + (pages * (i + 1) / k) * ps;
+        if (re > rs && !bindRange((void*) rs, re - rs, MPOL_PREFERRED,
+                                  std::vector<int>(1, nodes[i])))
+          return;
+      }
+    }
+  }
+}
+
+namespace hugepages {
+
+  const size_t hugePageSize = 1 << 21;
+  // Arrays smaller than one huge page cannot be backed by one.
+  const size_t hugeMinBytes = hugePageSize;
+
+  inline bool& enabled() {
+    static bool e = false;
+    return e;
+  }
+
+  // Turns huge page allocation on and reports the THP mode of the kernel;
+  // madvise has no effect when it is "never".
+  inline void enable(bool on) {
+    enabled() = on;
+    if (!on) return;
+    char mode[128] = "unknown";
+    FILE* f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    if (f != NULL) {
+      if (fgets(mode, sizeof(mode), f) == NULL) strcpy(mode, "unknown");
+      mode[strcspn(mode, "\n")] = '\0';
+      fclose(f);
+    }
+    printf("Huge pages: madvise + prefault for arrays >= 2MB (THP %s)\n", mode);
+  }
+
+  // Touches every base page of [p, p+bytes) in parallel, so the page faults
+  // (and huge page promotion) happen here rather than serially on first use.
+  inline void prefault(void* p, size_t bytes) {
+    volatile char* c = (volatile char*) p;
+    long ps = numa::pageSize();
+    long pages = (bytes + ps - 1) / ps;
+    par_for(0, pages, 0, [&] (long i) { c[i*ps] = 0; });
+  }
+}
+
+inline void* allocPlaced(size_t bytes, size_t alignment) {
+  bool huge = hugepages::enabled() && bytes >= hugepages::hugeMinBytes;
+  if (!huge && (numa::policy() == ALLOC_DEFAULT || bytes < numa::placeMinBytes)) {
+    if (alignment == 0) return malloc(bytes);
+    void* r;
+    if (posix_memalign(&r, alignment, bytes) != 0) return NULL;
+    return r;
+  }
+  size_t align = std::max(alignment, huge ? hugepages::hugePageSize : numa::pageSize());
+  // round huge blocks up to whole huge pages so the madvise range is ours
+  size_t len = huge ? (bytes + align - 1) / align * align : bytes;
+  void* r;
+  if (posix_memalign(&r, align, len) != 0) return NULL;
+  if (bytes >= numa::placeMinBytes) numa::placeArray(r, len);
+  if (huge) {
+    if (madvise(r, len, MADV_HUGEPAGE) != 0) perror("madvise(MADV_HUGEPAGE)");
+    hugepages::prefault(r, len);
+  }
+  return r;
+}
+
+// Allocates bytes, aligned to alignment when it is non-zero, and places the
+// block according to the NUMA policy and the huge page setting. Release with
+// free().
+inline void* allocArray(size_t bytes, size_t alignment = 0) {
+  void* r = allocPlaced(bytes, alignment);
+#ifdef MEM_STATS
+  mem_stats::track(r, bytes);
+#endif
+  return r;
+}
+
+// Allocates a page-aligned block whose pages are bound to the memory node in
+// the given slot, whatever the current policy. The block is rounded up to
+// whole pages, so the binding (and the migration it does) stays inside it.
+// Release with free().
+inline void* allocArrayOnNode(size_t bytes, int slot) {
+  size_t ps = numa::pageSize();
+  size_t len = std::max((bytes + ps - 1) / ps, (size_t) 1) * ps;
+  void* r;
+  if (posix_memalign(&r, ps, len) != 0) return NULL;
+  if (numa::numNodes() > 1 &&
+      numa::mbind(r, len, MPOL_BIND,
+                  std::vector<int>(1, numa::memoryNodes()[slot])) != 0)
+    perror("mbind");
+#ifdef MEM_STATS
+  mem_stats::track(r, bytes, "replica");
+#endif
+  return r;
+}
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef ATOMIC_STATS_H
+#define ATOMIC_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// **************************************************************
+//    ATOMIC CONTENTION PROFILING (ATOMIC_STATS)
+// **************************************************************
+
+// Compiled with ATOMIC_STATS, CAS and the helpers built on it (writeMin,
+// writeAdd, writeOr) count, per helper, the calls, the CAS attempts and the
+// failed attempts; the apps' own CAS calls (BFS, Radii) show up under CAS.
+// Each thread also keeps the addresses with the most failed attempts in a
+// small table (Space-Saving: a new address evicts the least counted entry
+// of its probe window and inherits its count, so hot addresses stay and
+// cold ones are approximate). The tables are merged by report(), which
+// prints the totals and the hottest destinations. Arrays registered with
+// ATOMIC_STATS_ARRAY are shown as name[vertex], other addresses in hex.
+// Without ATOMIC_STATS the macros are empty and the helpers are unchanged.
+
+namespace atomic_stats {
+
+  enum site { SITE_CAS, SITE_WRITEMIN, SITE_WRITEADD, SITE_WRITEOR, NUM_SITES };
+
+  inline const char* siteName(int s) {
+    static const char* names[] = {"CAS", "writeMin", "writeAdd", "writeOr"};
+    return names[s];
+  }
+
+  struct hot_entry { uintptr_t addr; long failures; };
+
+  struct alignas(64) thread_stats {
+    static const int table_size = 1 << 12;
+    static const int probes = 8;
+    long calls[NUM_SITES], attempts[NUM_SITES], failures[NUM_SITES];
+    hot_entry hot[table_size];
+
+    void fail(uintptr_t addr) {
+      uintptr_t h = (addr >> 2) * 0x9e3779b97f4a7c15ULL;
+      int start = h >> (64 - 12);
+      int victim = start;
+      for (int i = 0; i < probes; i++) {
+        hot_entry& e = hot[(start + i) & (table_size - 1)];
+        if (e.addr == addr) { e.failures++; return; }
+        if (e.failures == 0) { e.addr = addr; e.failures = 1; return; }
+        if (e.failures < hot[victim].failures) victim = (start + i) & (table_size - 1);
+      }
+      hot[victim].addr = addr;
+      hot[victim].failures++;
+    }
+  };
+
+  inline std::vector<thread_stats*>& threads() {
+    static std::vector<thread_stats*> t;
+    return t;
+  }
+
+  inline thread_stats& local() {
+    static thread_local thread_stats* mine = NULL;
+    if (mine == NULL) {
+      static std::mutex m;
+      std::lock_guard<std::mutex> lk(m);
+      mine = new thread_stats();
+      threads().push_back(mine);
+    }
+    return *mine;
+  }
+
+  inline void call(int s) { local().calls[s]++; }
+
+  inline bool attempt(int s, void* addr, bool success) {
+    thread_stats& t = local();
+    t.attempts[s]++;
+    if (!success) {
+      t.failures[s]++;
+      t.fail((uintptr_t) addr);
+    }
+    return success;
+  }
+
+  struct named_array { uintptr_t start; long n; size_t elt; std::string name; };
+
+  inline std::vector<named_array>& arrays() {
+    static std::vector<named_array> a;
+    return a;
+  }
+
+  // Names the n elements of size elt at p; replaces an array of the same
+  // name (apps allocate their arrays again in every round).
+  inline void name_array(const void* p, long n, size_t elt, const char* name) {
+    for (named_array& a : arrays())
+      if (a.name == name) { a = named_array{(uintptr_t) p, n, elt, name}; return; }
+    arrays().push_back(named_array{(uintptr_t) p, n, elt, name});
+  }
+
+  inline std::string describe(uintptr_t addr) {
+    char buf[128];
+    for (const named_array& a : arrays())
+      if (addr >= a.start && addr < a.start + a.n * a.elt) {
+        snprintf(buf, sizeof(buf), "%s[%lu]", a.name.c_str(),
+                 (unsigned long) ((addr - a.start) / a.elt));
+        return buf;
+      }
+    snprintf(buf, sizeof(buf), "0x%lx", (unsigned long) addr);
+    return buf;
+  }
+
+  // Prints the counts summed over the threads and the top destinations by
+  // failed attempts.
+  inline void report(int top = 10) {
+    long calls[NUM_SITES] = {0}, attempts[NUM_SITES] = {0}, failures[NUM_SITES] = {0};
+    std::map<uintptr_t, long> hot;
+    for (thread_stats* t : threads()) {
+      for (int s = 0; s < NUM_SITES; s++) {
+        calls[s] += t->calls[s]; attempts[s] += t->attempts[s]; failures[s] += t->failures[s];
+      }
+      for (int i = 0; i < thread_stats::table_size; i++)
+        if (t->hot[i].failures > 0) hot[t->hot[i].addr] += t->hot[i].failures;
+    }
+    printf("atomic stats over %zu thread(s)\n", threads().size());
+    printf("%-10s %14s %14s %14s %10s\n", "helper", "calls", "attempts", "failures", "fail %");
+    for (int s = 0; s < NUM_SITES; s++)
+      printf("%-10s %14ld %14ld %14ld %10.3f\n", siteName(s), calls[s], attempts[s],
+             failures[s], attempts[s] ? 100.0 * failures[s] / attempts[s] : 0.0);
+    std::vector<std::pair<long, uintptr_t> > v;
+    for (auto& e : hot) v.push_back(std::make_pair(e.second, e.first));
+    std::sort(v.rbegin(), v.rend());
+    if (v.empty()) return;
+    printf("hottest destinations by failed attempts:\n");
+    for (int i = 0; i < top && i < (int) v.size(); i++)
+      printf("  %-24s %14ld\n", describe(v[i].second).c_str(), v[i].first);
+  }
+}
+
+#ifdef ATOMIC_STATS
+#define ATOMIC_STATS_ARRAY(a, n) atomic_stats::name_array((a), (n), sizeof(*(a)), #a)
+#else
+#define ATOMIC_STATS_ARRAY(a, n)
+#endif
+
+#endif
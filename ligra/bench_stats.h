@@ -0,0 +1,59 @@
+#ifndef BENCH_STATS_H
+#define BENCH_STATS_H
+
+#include <math.h>
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Summaries of repeated timings and option list parsing, shared by the
+// benchmark harness (benchmark.h), apps/Microbench and apps/CodecBench.
+
+namespace benchmark {
+
+  struct summary { double median, min, max, mean, stddev; };
+
+  inline summary summarize(std::vector<double> v) {
+    summary s = {0, 0, 0, 0, 0};
+    if (v.empty()) return s;
+    std::sort(v.begin(), v.end());
+    size_t k = v.size();
+    s.median = (k % 2) ? v[k / 2] : (v[k / 2 - 1] + v[k / 2]) / 2;
+    s.min = v.front(); s.max = v.back();
+    for (double x : v) s.mean += x;
+    s.mean /= k;
+    for (double x : v) s.stddev += (x - s.mean) * (x - s.mean);
+    s.stddev = k > 1 ? sqrt(s.stddev / (k - 1)) : 0;
+    return s;
+  }
+
+  // Wall clock seconds of reps runs of f, each after setup (untimed), and
+  // after one untimed warm-up run.
+  template <class S, class F>
+  std::vector<double> timeRuns(long reps, S setup, F f) {
+    std::vector<double> times;
+    for (long r = -1; r < reps; r++) {
+      setup();
+      auto t0 = std::chrono::steady_clock::now();
+      f();
+      auto t1 = std::chrono::steady_clock::now();
+      if (r >= 0) times.push_back(std::chrono::duration<double>(t1 - t0).count());
+    }
+    return times;
+  }
+
+  inline std::vector<std::string> split(const std::string& s, char sep) {
+    std::vector<std::string> out;
+    size_t b = 0;
+    while (b <= s.size()) {
+      size_t e = s.find(sep, b);
+      if (e == std::string::npos) e = s.size();
+      if (e > b) out.push_back(s.substr(b, e - b));
+      b = e + 1;
+    }
+    return out;
+  }
+}
+
+#endif
@@ -0,0 +1,448 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "ligra.h"
+#include "chp_perf.h"
+#include "cache_model.h"
+#include "bench_stats.h"
+#include "ceilings.h"
+
+// **************************************************************
+//    BENCHMARK HARNESS (apps/Benchmark)
+// **************************************************************
+
+// Runs a matrix of apps x sources x thread counts on a graph that is loaded
+// once. Every cell is run -warmups times untimed and -reps times timed; the
+// median, min, max and standard deviation of the times, the edges examined
+// per run (the out-degrees of the frontiers edgeMap saw), GTEPS (edges over
+// the median time) and the mean of every -e counter are appended as one JSON
+// object per line to the -results file. With -baseline <file> (an earlier
+// results file) a cell whose median time grew by more than -threshold, or a
+// counter by more than -counter_threshold, is reported as a regression and
+// the harness exits with status 1. With -verify every cell gets one more,
+// untimed run in which the app checks its result (see verify.h); the
+// results lines say whether it passed, and a failure also makes the
+// harness exit with status 1.
+//
+// -scaling N is a thread-scaling sweep: the thread counts are 1, 2, 4, ...
+// up to N (N included), the workers are pinned (-pin compact unless -pin
+// is given) so that the first k workers keep their cpus at every point, and
+// after the results a table per app and source gives the speedup and the
+// parallel efficiency (speedup / threads) over the first point. The results
+// lines of every run carry the speedup and efficiency over the first thread
+// count of the list.
+//
+// -cache warm (the default) times runs that follow each other, with the
+// graph and the arrays left in the caches by the previous run. -cache cold
+// writes a buffer of -flush_size bytes (4x the last level cache of every
+// node by default) before every timed run, and -cache both measures each
+// cell both ways; the mode is part of every results line and of the key
+// the baseline is matched on (lines without one are warm). -cold_load,
+// handled by parallel_main, drops the input from the page cache before
+// the graph is read.
+//
+// -ceilings first measures, for every thread count, the sequential read,
+// random gather and atomic add rates on arrays of n words
+// (see ceilings.h), and then reports every edgeMap iteration of a cell
+// (its median time over the timed runs) as a fraction of them: below
+// the cell in the table and as "iterations" in its results line.
+
+namespace benchmark {
+
+  template <class vertex>
+  struct app {
+    const char* name;
+    bool takesSource;  // BFS-like apps get -r <source>; the others run once per cell
+    void (*run)(graph<vertex>&, commandLine, pvector<uintE>&);
+  };
+
+  // The command line of the harness with extra options in front, so that
+  // they take precedence over the harness' own; the input stays last.
+  class arguments {
+    std::vector<std::string> words;
+    std::vector<char*> argv;
+  public:
+    arguments(commandLine P, const std::vector<std::string>& extra) {
+      words.push_back(P.argv[0]);
+      for (const std::string& w : extra) words.push_back(w);
+      for (int i = 1; i < P.argc; i++) words.push_back(P.argv[i]);
+      for (std::string& w : words) argv.push_back(&w[0]);
+      argv.push_back(NULL);
+    }
+    commandLine line() { return commandLine(argv.size() - 1, argv.data(), ""); }
+  };
+
+  // Sends stdout to /dev/null while in scope, to keep the apps' [OUTPUT]
+  // lines out of the harness' table.
+  class quiet {
+    int saved;
+  public:
+    quiet(bool on) : saved(-1) {
+      if (!on) return;
+      fflush(stdout); std::cout.flush();
+      int null = open("/dev/null", O_WRONLY);
+      if (null < 0) return;
+      saved = dup(1);
+      dup2(null, 1);
+      close(null);
+    }
+    ~quiet() {
+      if (saved < 0) return;
+      fflush(stdout); std::cout.flush();
+      dup2(saved, 1);
+      close(saved);
+    }
+  };
+
+  // Evicts the caches by writing one byte of every line of a buffer larger
+  // than the last level caches, from all workers.
+  class flusher {
+    char* buf;
+    long bytes, line;
+  public:
+    flusher(long _bytes, long _line) : buf(NULL), bytes(_bytes), line(std::max(1L, _line)) {}
+    ~flusher() { if (buf != NULL) free(buf); }
+    void operator()() {
+      if (buf == NULL) {
+        buf = newA(char, bytes);
+        par_for(0, bytes, 0, [&] (long i) { buf[i] = 0; });
+      }
+      long lines = bytes / line;
+      char* b = buf;
+      long l = line;
+      par_for(0, lines, 0, [&] (long i) { b[i * l]++; });
+    }
+  };
+
+  struct cell {
+    std::string graph, app;
+    long threads, source;
+    std::string cache;
+    double median;
+    std::map<std::string, double> counters;
+  };
+
+  inline std::string key(const cell& c) {
+    return c.graph + "|" + c.app + "|" + std::to_string(c.threads) + "|" + std::to_string(c.source) +
+      "|" + c.cache;
+  }
+
+  // The value of "name": in a results line, without quotes; "" if absent.
+  inline std::string field(const std::string& line, const std::string& name) {
+    size_t p = line.find("\"" + name + "\":");
+    if (p == std::string::npos) return "";
+    p += name.size() + 3;
+    if (line[p] == '"') {
+      size_t e = line.find('"', p + 1);
+      return line.substr(p + 1, e - p - 1);
+    }
+    if (line[p] == '{') return line.substr(p + 1, line.find('}', p) - p - 1);
+    size_t e = line.find_first_of(",}", p);
+    return line.substr(p, e - p);
+  }
+
+  // Reads a results file written by an earlier run; later lines for the same
+  // cell replace earlier ones.
+  inline std::map<std::string, cell> readBaseline(const std::string& filename) {
+    std::map<std::string, cell> cells;
+    FILE* f = fopen(filename.c_str(), "r");
+    if (f == NULL) { perror(filename.c_str()); return cells; }
+    char* buf = NULL;
+    size_t len = 0;
+    while (getline(&buf, &len, f) > 0) {
+      std::string line(buf);
+      cell c;
+      c.graph = field(line, "graph"); c.app = field(line, "app");
+      if (c.app == "") continue;
+      c.threads = atol(field(line, "threads").c_str());
+      c.source = atol(field(line, "source").c_str());
+      c.cache = field(line, "cache");
+      if (c.cache == "") c.cache = "warm";
+      c.median = atof(field(line, "median_s").c_str());
+      for (const std::string& kv : split(field(line, "counters"), ',')) {
+        size_t colon = kv.rfind(':');
+        if (colon == std::string::npos || kv.size() < 2) continue;
+        c.counters[kv.substr(1, colon - 2)] = atof(kv.substr(colon + 1).c_str());
+      }
+      cells[key(c)] = c;
+    }
+    free(buf);
+    fclose(f);
+    return cells;
+  }
+
+  // Compares a cell with the baseline; prints and counts the regressions.
+  inline int compare(const cell& c, const std::map<std::string, cell>& baseline,
+                     double threshold, double counterThreshold) {
+    auto it = baseline.find(key(c));
+    if (it == baseline.end()) return 0;
+    const cell& b = it->second;
+    int regressions = 0;
+    if (b.median > 0 && c.median > b.median * (1 + threshold)) {
+      printf("REGRESSION %s threads=%ld source=%ld %s: median %.6f s, baseline %.6f s (%+.1f%%)\n",
+             c.app.c_str(), c.threads, c.source, c.cache.c_str(), c.median, b.median, 100 * (c.median / b.median - 1));
+      regressions++;
+    }
+    for (auto& kv : c.counters) {
+      auto bc = b.counters.find(kv.first);
+      if (bc == b.counters.end() || bc->second <= 0) continue;
+      if (kv.second > bc->second * (1 + counterThreshold)) {
+        printf("REGRESSION %s threads=%ld source=%ld %s: %s %.0f, baseline %.0f (%+.1f%%)\n",
+               c.app.c_str(), c.threads, c.source, c.cache.c_str(), kv.first.c_str(), kv.second, bc->second,
+               100 * (kv.second / bc->second - 1));
+        regressions++;
+      }
+    }
+    return regressions;
+  }
+
+  // 1, 2, 4, ... up to n, with n itself last.
+  inline std::vector<std::string> doublings(long n) {
+    std::vector<std::string> r;
+    for (long t = 1; t < n; t *= 2) r.push_back(std::to_string(t));
+    r.push_back(std::to_string(std::max(1L, n)));
+    return r;
+  }
+
+  struct point { std::string app; long source, threads; std::string cache; double median, gteps; };
+
+  // Prints speedup and efficiency over the first point of each app and source.
+  inline void printScaling(const std::vector<point>& points) {
+    std::map<std::string, const point*> first;
+    printf("%-14s %8s %5s %7s %11s %9s %10s %9s\n", "app", "source", "cache", "threads", "median s",
+           "speedup", "efficiency", "GTEPS");
+    std::vector<std::string> order;
+    std::map<std::string, std::vector<const point*> > rows;
+    for (const point& p : points) {
+      std::string k = p.app + "|" + std::to_string(p.source) + "|" + p.cache;
+      if (rows.find(k) == rows.end()) order.push_back(k);
+      rows[k].push_back(&p);
+    }
+    for (const std::string& k : order) {
+      const point* base = rows[k][0];
+      for (const point* p : rows[k]) {
+        double speedup = p->median > 0 ? base->median / p->median : 0;
+        printf("%-14s %8ld %5s %7ld %11.6f %9.2f %10.2f %9.4f\n", p->app.c_str(), p->source,
+               p->cache.c_str(), p->threads, p->median, speedup, speedup * base->threads / p->threads, p->gteps);
+      }
+    }
+  }
+
+  // Sources in the original id space, sampled as BC samples them. Empty,
+  // with an error, when no vertex has an out-edge to sample.
+  template <class vertex>
+  std::vector<long> sampleSources(graph<vertex>& GA, pvector<uintE>& new_ids, long count) {
+    std::vector<long> sources;
+    long active = sequence::reduce<long>((long) 0, GA.n, addF<long>(), [&] (long v) {
+      return (long) (GA.V[v].getOutDegree() > 0); });
+    if (active == 0) {
+      fprintf(stderr, "benchmark: no vertex has an out-edge, no sources to sample\n");
+      return sources;
+    }
+    bool preprocessed = (new_ids[0] != new_ids[1]);
+    std::mt19937 rng(27491095);
+    std::uniform_int_distribution<long> udist(0, GA.n - 1);
+    for (long i = 0; i < count; i++) {
+      long s;
+      do s = udist(rng);
+      while (GA.V[preprocessed ? new_ids[s] : s].getOutDegree() == 0);
+      sources.push_back(s);
+    }
+    return sources;
+  }
+
+  template <class vertex>
+  void run(graph<vertex>& GA, commandLine P, pvector<uintE>& new_ids, std::vector<app<vertex>>& apps) {
+    std::string all;
+    for (app<vertex>& a : apps) all += std::string(all == "" ? "" : ",") + a.name;
+    std::vector<std::string> selected = split(P.getOptionValue("-apps", all), ',');
+    std::vector<std::string> threadList = split(P.getOptionValue("-threads", std::to_string(getWorkers())), ',');
+    long numSources = std::max(1L, P.getOptionLongValue("-sources", 1));
+    long warmups = P.getOptionLongValue("-warmups", 1);
+    long reps = std::max(1L, P.getOptionLongValue("-reps", 5));
+    std::string events = P.getOptionValue("-e", "task-clock");
+    std::string results = P.getOptionValue("-results", "benchmark.jsonl");
+    std::string baselineFile = P.getOptionValue("-baseline", "");
+    double threshold = P.getOptionDoubleValue("-threshold", 0.05);
+    double counterThreshold = P.getOptionDoubleValue("-counter_threshold", 0.10);
+    bool verbose = P.getOption("-verbose");
+    long scaling = P.getOptionLongValue("-scaling", 0);
+    std::string cacheMode = P.getOptionValue("-cache", "warm");
+    bool withCeilings = P.getOption("-ceilings");
+    long ceilingReps = std::max(1L, P.getOptionLongValue("-ceiling_reps", 5));
+    std::vector<std::string> cacheModes;
+    if (cacheMode == "warm" || cacheMode == "both") cacheModes.push_back("warm");
+    if (cacheMode == "cold" || cacheMode == "both") cacheModes.push_back("cold");
+    if (cacheModes.empty()) {
+      fprintf(stderr, "benchmark: unknown -cache %s, using warm\n", cacheMode.c_str());
+      cacheModes.push_back("warm");
+    }
+    // -verify (read by parallel_main) checks one extra run of every cell
+    bool verifying = verify::enabled();
+    verify::enabled() = false;
+    cache_model::config llc = cache_model::lastLevel();
+    flusher flush(cache_model::parseSize(P.getOptionValue("-flush_size", ""),
+                                         4 * llc.size * numa::numNodes()), llc.line);
+    if (scaling > 0) {
+      threadList = doublings(scaling);
+      if (!affinity::pinned()) {
+        setWorkers(scaling);
+        affinity::pin("compact", P.getOption("-physical"));
+      }
+    }
+
+    std::string graphName = P.getArgument(0);
+    graphName = graphName.substr(graphName.rfind('/') + 1);
+    std::vector<long> sources = sampleSources(GA, new_ids, numSources);
+    if ((long) sources.size() < numSources) exit(1);
+    std::map<std::string, cell> baseline;
+    if (baselineFile != "") baseline = readBaseline(baselineFile);
+    FILE* out = fopen(results.c_str(), "a");
+    if (out == NULL) { perror(results.c_str()); return; }
+
+    printf("%-14s %7s %8s %5s %11s %11s %11s %9s\n", "app", "threads", "source", "cache", "median s",
+           "min s", "stddev s", "GTEPS");
+    int regressions = 0, failed = 0;
+    std::vector<point> points;
+    std::map<std::string, double> firstMedian;
+    for (const std::string& t : threadList) {
+      long threads = atol(t.c_str());
+      if (threads < 1) continue;
+      setWorkers(threads);
+      if (affinity::pinned()) affinity::pinWorkers();  // new threads take their cpus
+      ceilings::rates ceiling = {GA.n, 0, 0, 0};
+      if (withCeilings) {
+        ceiling = ceilings::measure(GA.n, ceilingReps);
+        printf("ceilings, %ld threads, %ld words: read %.2f GB/s, gather %.1f M/s, "
+               "atomic add %.1f M/s\n", threads, GA.n, ceiling.read / 1e9, ceiling.gather / 1e6,
+               ceiling.atomic / 1e6);
+      }
+      struct perf_struct* perf = init_perf(events);
+      for (const std::string& name : selected) {
+        app<vertex>* a = NULL;
+        for (app<vertex>& x : apps) if (name == x.name) a = &x;
+        if (a == NULL) { fprintf(stderr, "benchmark: unknown app %s, skipped\n", name.c_str()); continue; }
+        std::vector<long> cellSources = a->takesSource ? sources : std::vector<long>{-1};
+        for (long source : cellSources) {
+          // the apps' own counters are turned off, the harness counts
+          std::vector<std::string> extra = {"-e", ""};
+          if (source >= 0) { extra.push_back("-r"); extra.push_back(std::to_string(source)); }
+          arguments args(P, extra);
+          auto once = [&] () {
+            quiet q(!verbose);
+            a->run(GA, args.line(), new_ids);
+            if (GA.transposed) GA.transpose();
+          };
+          const char* verified = "null";
+          if (verifying) {
+            long before = verify::failures();
+            verify::enabled() = true;
+            once();
+            verify::enabled() = false;
+            verified = verify::failures() == before ? "true" : "false";
+            if (verify::failures() != before) {
+              printf("VERIFY FAILED %s threads=%ld source=%ld (rerun with -verbose for details)\n",
+                     a->name, threads, source);
+              failed++;
+            }
+          }
+          for (long w = 0; w < warmups; w++) once();
+          for (const std::string& cache : cacheModes) {
+            std::vector<double> times;
+            std::vector<double> sums(perf->nr, 0);
+            long edges = 0;
+            std::vector<std::vector<traversal_stats::iteration> > runs(withCeilings ? reps : 0);
+            for (long r = 0; r < reps; r++) {
+              if (cache == "cold") flush();
+              if (withCeilings) traversal_stats::collector() = &runs[r];
+              long examined = traversal_stats::examined();
+              reset_counter(perf);
+              start_counter(perf);
+              auto t0 = std::chrono::steady_clock::now();
+              once();
+              auto t1 = std::chrono::steady_clock::now();
+              stop_counter(perf);
+              traversal_stats::collector() = NULL;
+              times.push_back(std::chrono::duration<double>(t1 - t0).count());
+              edges += traversal_stats::examined() - examined;
+              std::vector<double> totals = read_totals(perf);
+              for (size_t e = 0; e < totals.size(); e++) sums[e] += totals[e];
+            }
+            summary s = summarize(times);
+            double perRun = (double) edges / reps;
+            double gteps = s.median > 0 ? perRun / s.median / 1e9 : 0;
+            printf("%-14s %7ld %8ld %5s %11.6f %11.6f %11.6f %9.4f\n", a->name, threads, source,
+                   cache.c_str(), s.median, s.min, s.stddev, gteps);
+            std::vector<traversal_stats::iteration> iterations = ceilings::medians(runs);
+            if (withCeilings && !iterations.empty())
+              printf("  %5s %-13s %10s %12s %10s %9s %7s %8s\n", "iter", "mode", "frontier", "edges", "ms",
+                     "Me/s", "read", "random");
+            for (size_t i = 0; i < iterations.size(); i++) {
+              traversal_stats::iteration& it = iterations[i];
+              ceilings::fraction f = ceilings::of(ceiling, it.outDegrees, it.ns * 1e-9, it.mode);
+              printf("  %5zu %-13s %10ld %12ld %10.3f %9.1f %7.3f %8.3f\n", i + 1, it.mode, it.frontier,
+                     it.outDegrees, it.ns * 1e-6, f.edgesPerSecond / 1e6, f.read, f.random);
+            }
+
+            std::string k = std::string(a->name) + "|" + std::to_string(source) + "|" + cache;
+            if (firstMedian.find(k) == firstMedian.end()) firstMedian[k] = s.median;
+            double speedup = s.median > 0 ? firstMedian[k] / s.median : 0;
+            long firstThreads = atol(threadList[0].c_str());
+            points.push_back(point{a->name, source, threads, cache, s.median, gteps});
+
+            cell c = {graphName, a->name, threads, source, cache, s.median, {}};
+            fprintf(out, "{\"graph\":\"%s\",\"app\":\"%s\",\"threads\":%ld,\"source\":%ld,"
+                    "\"cache\":\"%s\",\"warmups\":%ld,\"reps\":%ld,\"median_s\":%.9f,\"min_s\":%.9f,"
+                    "\"max_s\":%.9f,\"stddev_s\":%.9f,\"edges\":%.0f,\"gteps\":%.6f,\"speedup\":%.4f,"
+                    "\"efficiency\":%.4f,\"verified\":%s,\"counters\":{",
+                    graphName.c_str(), a->name, threads, source, cache.c_str(), warmups, reps,
+                    s.median, s.min, s.max, s.stddev, perRun, gteps, speedup,
+                    speedup * firstThreads / threads, verified);
+            for (size_t e = 0; e < perf->nr; e++) {
+              c.counters[perf->events[e].name] = sums[e] / reps;
+              fprintf(out, "%s\"%s\":%.0f", e ? "," : "", perf->events[e].name.c_str(), sums[e] / reps);
+            }
+            fprintf(out, "}");
+            if (withCeilings) {
+              fprintf(out, ",\"ceilings\":{\"words\":%ld,\"read_bytes_per_s\":%.0f,\"gather_per_s\":%.0f,"
+                      "\"atomic_per_s\":%.0f},\"iterations\":[", ceiling.n,
+                      ceiling.read, ceiling.gather, ceiling.atomic);
+              for (size_t i = 0; i < iterations.size(); i++) {
+                traversal_stats::iteration& it = iterations[i];
+                ceilings::fraction f = ceilings::of(ceiling, it.outDegrees, it.ns * 1e-9, it.mode);
+                fprintf(out, "%s{\"mode\":\"%s\",\"frontier\":%ld,\"out_degrees\":%ld,\"ns\":%ld,"
+                        "\"read_fraction\":%.4f,\"random_fraction\":%.4f}", i ? "," : "", it.mode,
+                        it.frontier, it.outDegrees, it.ns, f.read, f.random);
+              }
+              fprintf(out, "]");
+            }
+            fprintf(out, "}\n");
+            fflush(out);
+            regressions += compare(c, baseline, threshold, counterThreshold);
+          }
+        }
+      }
+      free_perf(perf);
+    }
+    fclose(out);
+    if (scaling > 0) printScaling(points);
+    printf("results appended to %s\n", results.c_str());
+    if (verifying) printf("%d cell(s) failed verification\n", failed);
+    if (baselineFile != "") printf("%d regression(s) against %s\n", regressions, baselineFile.c_str());
+    if (regressions > 0 || failed > 0) exit(1);
+  }
+}
+
+#endif
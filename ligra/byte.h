@@ -281,20 +281,20 @@ uintE *parallelCompressEdges(uintE *edges, uintT *offsets, long n, long m, uintE
   uintE **edgePts = newA(uintE*, n);
   long *charsUsedArr = newA(long, n);
   long *compressionStarts = newA(long, n+1);
-  {parallel_for(long i=0; i<n; i++) {
+  {par_for(0, n, 0, [&] (long i) {
     charsUsedArr[i] = ceil((Degrees[i] * 9) / 8) + 4;
-  }}
+  });}
   long toAlloc = sequence::plusScan(charsUsedArr,charsUsedArr,n);
   uintE* iEdges = newA(uintE,toAlloc);
 
-  {parallel_for(long i=0; i<n; i++) {
+  {par_for(0, n, 0, [&] (long i) {
       edgePts[i] = iEdges+charsUsedArr[i];
       long charsUsed =
 	sequentialCompressEdgeSet((uchar *)(iEdges+charsUsedArr[i]),
 				  0, Degrees[i],
 				  i, edges + offsets[i]);
       charsUsedArr[i] = charsUsed;
-  }}
+  });}
 
   // produce the total space needed for all compressed lists in chars.
   long totalSpace = sequence::plusScan(charsUsedArr, compressionStarts, n);
@@ -306,11 +306,11 @@ uintE *parallelCompressEdges(uintE *edges, uintT *offsets, long n, long m, uintE
   float avgBitsPerEdge = (float)totalSpace*8 / (float)m;
   cout << "Average bits per edge: " << avgBitsPerEdge << endl;
 
-  {parallel_for(long i=0; i<n; i++) {
+  {par_for(0, n, 0, [&] (long i) {
       long o = compressionStarts[i];
     memcpy(finalArr + o, (uchar *)(edgePts[i]), compressionStarts[i+1]-o);
     offsets[i] = o;
-  }}
+  });}
   offsets[n] = totalSpace;
   free(iEdges);
   free(edgePts);
@@ -368,18 +368,18 @@ uchar *parallelCompressWeightedEdges(intEPair *edges, uintT *offsets, long n, lo
   uintE **edgePts = newA(uintE*, n);
   long *charsUsedArr = newA(long, n);
   long *compressionStarts = newA(long, n+1);
-  {parallel_for(long i=0; i<n; i++) {
+  {par_for(0, n, 0, [&] (long i) {
     charsUsedArr[i] = 2*(ceil((Degrees[i] * 9) / 8) + 4); //to change
-  }}
+  });}
   long toAlloc = sequence::plusScan(charsUsedArr,charsUsedArr,n);
   uintE* iEdges = newA(uintE,toAlloc);
 
-  {parallel_for(long i=0; i<n; i++) {
+  {par_for(0, n, 0, [&] (long i) {
     edgePts[i] = iEdges+charsUsedArr[i];
     long charsUsed =
       sequentialCompressWeightedEdgeSet((uchar *)(iEdges+charsUsedArr[i]), 0, Degrees[i],i, edges + offsets[i]);
     charsUsedArr[i] = charsUsed;
-  }}
+  });}
 
   // produce the total space needed for all compressed lists in chars.
   long totalSpace = sequence::plusScan(charsUsedArr, compressionStarts, n);
@@ -391,11 +391,11 @@ uchar *parallelCompressWeightedEdges(intEPair *edges, uintT *offsets, long n, lo
   float avgBitsPerEdge = (float)totalSpace*8 / (float)m;
   cout << "Average bits per edge: " << avgBitsPerEdge << endl;
 
-  {parallel_for(long i=0; i<n; i++) {
+  {par_for(0, n, 0, [&] (long i) {
       long o = compressionStarts[i];
     memcpy(finalArr + o, (uchar *)(edgePts[i]), compressionStarts[i+1]-o);
     offsets[i] = o;
-  }}
+  });}
   offsets[n] = totalSpace;
   free(iEdges);
   free(edgePts);
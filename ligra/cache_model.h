@@ -0,0 +1,110 @@
+#ifndef CACHE_MODEL_H
+#define CACHE_MODEL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// **************************************************************
+//    SET-ASSOCIATIVE LRU CACHE MODEL
+// **************************************************************
+
+// A cache of sets x ways lines of line bytes with LRU replacement, fed one
+// address at a time; used by apps/CacheModel to score vertex orderings.
+// The model has no notion of time or coherence: it counts the misses of
+// one access stream.
+
+namespace cache_model {
+
+  struct config {
+    size_t size, line, ways;
+  };
+
+  // Reads one number from a sysfs cache file, with a K or M suffix.
+  inline size_t readSize(const std::string& path) {
+    FILE* f = fopen(path.c_str(), "r");
+    if (f == NULL) return 0;
+    size_t v = 0;
+    char unit = 0;
+    int k = fscanf(f, "%zu%c", &v, &unit);
+    fclose(f);
+    if (k < 1) return 0;
+    if (unit == 'K') v <<= 10;
+    else if (unit == 'M') v <<= 20;
+    return v;
+  }
+
+  // The last level data or unified cache of cpu0, from sysfs; 32MB, 64 byte
+  // lines and 16 ways where sysfs has no cache information.
+  inline config lastLevel() {
+    config c = {32 << 20, 64, 16};
+    int best = 0;
+    for (int i = 0; i < 16; i++) {
+      std::string dir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(i) + "/";
+      size_t level = readSize(dir + "level");
+      if (level == 0) break;
+      char type[32] = "";
+      FILE* f = fopen((dir + "type").c_str(), "r");
+      if (f != NULL) { if (fscanf(f, "%31s", type) != 1) type[0] = 0; fclose(f); }
+      if (strcmp(type, "Instruction") == 0 || (int) level < best) continue;
+      size_t size = readSize(dir + "size"), line = readSize(dir + "coherency_line_size");
+      size_t ways = readSize(dir + "ways_of_associativity");
+      if (size == 0 || line == 0 || ways == 0) continue;
+      best = level;
+      c = config{size, line, ways};
+    }
+    return c;
+  }
+
+  // Parses a size such as 32M, 512K or 1048576.
+  inline size_t parseSize(const std::string& s, size_t def) {
+    if (s == "") return def;
+    char* end;
+    size_t v = strtoull(s.c_str(), &end, 10);
+    if (*end == 'K' || *end == 'k') v <<= 10;
+    else if (*end == 'M' || *end == 'm') v <<= 20;
+    else if (*end == 'G' || *end == 'g') v <<= 30;
+    return v;
+  }
+
+  class lru_cache {
+    size_t sets, ways;
+    int lineBits;
+    std::vector<uint64_t> tags;  // per set, most recently used first
+
+  public:
+    long accesses, misses;
+
+    // A cache of about size bytes; at least one set.
+    lru_cache(size_t size, size_t line, size_t _ways) : ways(std::max((size_t) 1, _ways)) {
+      lineBits = 0;
+      while (((size_t) 1 << (lineBits + 1)) <= line) lineBits++;
+      sets = std::max((size_t) 1, size / (((size_t) 1 << lineBits) * ways));
+      tags.assign(sets * ways, ~0ULL);
+      accesses = misses = 0;
+    }
+
+    void clear() { std::fill(tags.begin(), tags.end(), ~0ULL); }
+
+    // Accesses addr; returns true on a hit.
+    bool access(uint64_t addr) {
+      uint64_t tag = addr >> lineBits;
+      uint64_t* set = &tags[(tag % sets) * ways];
+      accesses++;
+      size_t w = 0;
+      while (w < ways && set[w] != tag) w++;
+      bool hit = w < ways;
+      if (!hit) { misses++; w = ways - 1; }
+      // move to the front, evicting the last way on a miss
+      for (; w > 0; w--) set[w] = set[w - 1];
+      set[0] = tag;
+      return hit;
+    }
+  };
+}
+
+#endif
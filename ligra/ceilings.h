@@ -0,0 +1,110 @@
+#ifndef CEILINGS_H
+#define CEILINGS_H
+
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "parallel.h"
+#include "utils.h"
+#include "sequence.h"
+#include "stats.h"
+#include "bench_stats.h"
+
+// **************************************************************
+//    MEMORY CEILINGS (apps/Benchmark -ceilings)
+// **************************************************************
+
+// The rates of the memory operations a traversal is made of, measured on
+// arrays of n 8 byte words (the size of the per-vertex arrays of a graph
+// with n vertices) by the workers the apps will run on:
+//
+//   read     sequential read bandwidth (a sum over the array), bytes/s
+//   gather   B[i] = A[idx[i]] for uniformly random idx, per second
+//   atomic   writeAdd(&A[idx[i]], 1), per second
+//
+// Each rate is the median of -ceiling_reps (5) timed runs, each of which
+// makes at least 2^24 operations (several passes over a small array).
+//
+// An edgeMap iteration that examines e edges in t seconds streams at least
+// e edge targets (4 bytes each) and makes about one random access per edge
+// to a per-vertex array: a read of the source's value in dense (pull) mode
+// and an atomic update (updateAtomic, through decodeOutNgh) in sparse and
+// dense_forward mode, which both push. of() gives e/t against those
+// ceilings; a value near 1 means the iteration runs at the speed of the
+// memory system.
+
+namespace ceilings {
+
+  struct rates {
+    long n;
+    double read, gather, atomic;
+  };
+
+  inline rates measure(long n, long reps) {
+    rates r = {n, 0, 0, 0};
+    n = std::max(1L, n);
+    long passes = std::max(1L, (1L << 24) / n);
+    long* A = newA(long, n);
+    long* B = newA(long, n);
+    uintE* idx = newA(uintE, n);
+    {par_for(0, n, 0, [&] (long i) {
+      A[i] = i; B[i] = i;
+      idx[i] = hashInt((ulong) i) % n;
+    });}
+    auto none = [] () {};
+    auto rate = [&] (double perPass, std::vector<double> times) {
+      double t = benchmark::summarize(times).median;
+      return t > 0 ? perPass * passes / t : 0;
+    };
+    volatile long sum = 0;  // keeps the reads
+    r.read = rate(n * sizeof(long), benchmark::timeRuns(reps, none, [&] () {
+        for (long p = 0; p < passes; p++) sum += sequence::plusReduce(A, n); }));
+    r.gather = rate(n, benchmark::timeRuns(reps, none, [&] () {
+        for (long p = 0; p < passes; p++) { par_for(0, n, 0, [&] (long i) { B[i] = A[idx[i]]; }); } }));
+    r.atomic = rate(n, benchmark::timeRuns(reps, none, [&] () {
+        for (long p = 0; p < passes; p++) { par_for(0, n, 0, [&] (long i) { writeAdd(&A[idx[i]], 1L); }); } }));
+    free(A); free(B); free(idx);
+    return r;
+  }
+
+  // The random access ceiling of an edgeMap mode.
+  inline double randomCeiling(const rates& r, const std::string& mode) {
+    if (mode == "sparse" || mode == "dense_forward") return r.atomic;
+    if (mode == "dense") return r.gather;
+    return 0;
+  }
+
+  struct fraction {
+    double edgesPerSecond;
+    double read;    // bytes of edge targets per second over the read ceiling
+    double random;  // edges per second over the ceiling of the mode
+  };
+
+  inline fraction of(const rates& r, long edges, double seconds, const std::string& mode) {
+    fraction f = {0, 0, 0};
+    if (seconds <= 0) return f;
+    f.edgesPerSecond = edges / seconds;
+    if (r.read > 0) f.read = f.edgesPerSecond * sizeof(uintE) / r.read;
+    double c = randomCeiling(r, mode);
+    if (c > 0) f.random = f.edgesPerSecond / c;
+    return f;
+  }
+
+  // The median time of every iteration over runs that made the same
+  // iterations; the frontier, edges and mode are those of the first run.
+  inline std::vector<traversal_stats::iteration> medians(
+      const std::vector<std::vector<traversal_stats::iteration> >& runs) {
+    std::vector<traversal_stats::iteration> m;
+    if (runs.empty()) return m;
+    m = runs[0];
+    for (size_t i = 0; i < m.size(); i++) {
+      std::vector<double> ns;
+      for (const auto& run : runs) if (i < run.size()) ns.push_back(run[i].ns);
+      m[i].ns = (long) benchmark::summarize(ns).median;
+    }
+    return m;
+  }
+}
+
+#endif
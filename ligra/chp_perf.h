@@ -1,3 +1,6 @@
+#ifndef CHP_PERF_H
+#define CHP_PERF_H
+
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,6 +11,7 @@
 #include <linux/hw_breakpoint.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
+#include <sys/syscall.h>
 #include <filesystem>
 
 #include <locale.h>
@@ -17,6 +21,11 @@
 #include <vector>
 #include <fstream>
 #include <chrono>
+#include <map>
+#include <tuple>
+#include "parallel.h"
+#include "stats.h"
+#include "trace.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -43,20 +52,135 @@ extern "C"
     void start_counter(struct perf_struct *perf);
     void stop_counter(struct perf_struct *perf);
     void read_counter(struct perf_struct *perf, struct counter_arr *ctrs, std::string output_filename);
+    void free_perf(struct perf_struct *perf);
     void print_aggregate_counter(struct counter_arr *ctrs);
 
-    std::vector<__u64> convertToLongArray(std::string input)
+    // One event of the -e list. Events are given by name, as perf(1) spells
+    // them (cycles, instructions, cache-misses, LLC-load-misses,
+    // dTLB-load-misses, task-clock, ...), or as raw configs in hex
+    // ("r53003c", "0x53003c" or "53003c"). A ":u" suffix counts user space
+    // only, ":k" kernel only and ":uk" both; without a suffix only user space
+    // is counted.
+    struct perf_event_spec
+    {
+        std::string name;
+        __u32 type;
+        __u64 config;
+        bool exclude_user, exclude_kernel;
+    };
+
+    bool parse_cache_event(const std::string &name, __u64 &config)
+    {
+        static const char *caches[] = {"L1-dcache", "L1-icache", "LLC", "dTLB",
+                                       "iTLB", "branch", "node"};
+        static const __u64 cache_ids[] = {
+            PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_L1I, PERF_COUNT_HW_CACHE_LL,
+            PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_ITLB, PERF_COUNT_HW_CACHE_BPU,
+            PERF_COUNT_HW_CACHE_NODE};
+        static const char *ops[] = {"loads", "load-misses", "stores", "store-misses",
+                                    "prefetches", "prefetch-misses"};
+        static const __u64 op_ids[] = {PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_OP_READ,
+                                       PERF_COUNT_HW_CACHE_OP_WRITE, PERF_COUNT_HW_CACHE_OP_WRITE,
+                                       PERF_COUNT_HW_CACHE_OP_PREFETCH,
+                                       PERF_COUNT_HW_CACHE_OP_PREFETCH};
+        for (size_t c = 0; c < sizeof(caches) / sizeof(caches[0]); c++)
+            for (size_t o = 0; o < sizeof(ops) / sizeof(ops[0]); o++)
+                if (name == std::string(caches[c]) + "-" + ops[o])
+                {
+                    __u64 result = (o % 2) ? PERF_COUNT_HW_CACHE_RESULT_MISS
+                                           : PERF_COUNT_HW_CACHE_RESULT_ACCESS;
+                    config = cache_ids[c] | (op_ids[o] << 8) | (result << 16);
+                    return true;
+                }
+        return false;
+    }
+
+    bool parse_event(std::string item, struct perf_event_spec &e)
+    {
+        static const struct
+        {
+            const char *name;
+            __u32 type;
+            __u64 config;
+        } named[] = {
+            {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {"cpu-cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {"cache-references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+            {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {"branches", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+            {"branch-instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+            {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {"bus-cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BUS_CYCLES},
+            {"stalled-cycles-frontend", PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_FRONTEND},
+            {"stalled-cycles-backend", PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_BACKEND},
+            {"ref-cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_REF_CPU_CYCLES},
+            {"cpu-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_CLOCK},
+            {"task-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+            {"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+            {"faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+            {"minor-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MIN},
+            {"major-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MAJ},
+            {"context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+            {"cs", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+            {"cpu-migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+            {"migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+        };
+        e.name = item;
+        e.exclude_user = false;
+        e.exclude_kernel = true;
+        size_t colon = item.find(':');
+        if (colon != std::string::npos)
+        {
+            std::string mod = item.substr(colon + 1);
+            item = item.substr(0, colon);
+            if (mod.empty() || mod.find_first_not_of("uk") != std::string::npos)
+                return false;
+            e.exclude_user = mod.find('u') == std::string::npos;
+            e.exclude_kernel = mod.find('k') == std::string::npos;
+        }
+        for (size_t i = 0; i < sizeof(named) / sizeof(named[0]); i++)
+            if (item == named[i].name)
+            {
+                e.type = named[i].type;
+                e.config = named[i].config;
+                return true;
+            }
+        if (parse_cache_event(item, e.config))
+        {
+            e.type = PERF_TYPE_HW_CACHE;
+            return true;
+        }
+        std::string hex = item;
+        if (hex.size() > 1 && hex[0] == 'r')
+            hex = hex.substr(1);
+        else if (hex.size() > 2 && hex[0] == '0' && (hex[1] == 'x' || hex[1] == 'X'))
+            hex = hex.substr(2);
+        if (hex.empty() || hex.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+            return false;
+        e.type = PERF_TYPE_RAW;
+        e.config = std::stoull(hex, nullptr, 16);
+        return true;
+    }
+
+    // Parses the comma separated event list; unknown names are reported and
+    // skipped.
+    std::vector<struct perf_event_spec> parse_events(std::string input)
     {
         std::istringstream stringReader{input};
 
-        std::vector<__u64> result;
+        std::vector<struct perf_event_spec> result;
 
-        __u64 number;
         string item;
         while (std::getline(stringReader, item, ','))
         {
-            number = std::stoll(item, nullptr, 16);
-            result.push_back(number);
+            if (item.empty())
+                continue;
+            struct perf_event_spec e;
+            if (parse_event(item, e))
+                result.push_back(e);
+            else
+                fprintf(stderr, "chp_perf: unknown event %s, skipped\n", item.c_str());
         }
 
         return result;
@@ -72,128 +196,177 @@ extern "C"
         return ret;
     }
 
+    // The events of one thread. Every event has its own fd; leader[i] is
+    // the index of the event whose fd leads the group event i belongs to.
+    // All threads use the same grouping.
+    struct perf_group
+    {
+        pid_t tid;
+        std::vector<int> fd;
+        std::vector<unsigned long> id;
+    };
+
+    // Hardware events per group. The kernel refuses a group that can never
+    // fit the PMU, but does not know about counters taken by others (such as
+    // the NMI watchdog), so groups are kept below the usual four general
+    // purpose counters per hardware thread.
+    const size_t perf_max_group = 3;
+
     struct perf_struct
     {
-        struct perf_event_attr pe;
-        int perf_fd[5];
-        unsigned long perf_id[5];
+        std::vector<struct perf_event_spec> events;
+        std::vector<size_t> leader;
+        std::vector<struct perf_group> groups;
         size_t nr;
         std::chrono::high_resolution_clock::time_point startTime;
         int64_t duration;
     };
 
-    struct perf_struct *init_perf(std::string event_configs_str)
+    // Thread ids of the main thread and of the workers. OpenMP threads are
+    // collected with a parallel region (libgomp keeps the same threads for
+    // later regions of the same size); the HOMEGROWN scheduler lists its
+    // own. Cilk workers cannot be enumerated; there the group of the main
+    // thread inherits to threads created later.
+    std::vector<pid_t> worker_tids()
     {
-        //__u64 event_configs[] = &(convertToIntArray("0x5301c0, 0x53003c")[0]);
-        std::vector<__u64> event_configs = convertToLongArray(event_configs_str);
-
-        struct perf_struct *perf;
-
-        setlocale(LC_NUMERIC, ""); // For comma seperated printouts
+        std::vector<pid_t> tids(1, (pid_t)syscall(SYS_gettid));
+#if defined(OPENMP)
+        std::vector<pid_t> omp(omp_get_max_threads(), 0);
+#pragma omp parallel
+        omp[omp_get_thread_num()] = (pid_t)syscall(SYS_gettid);
+        tids.insert(tids.end(), omp.begin(), omp.end());
+#endif
+#if defined(HOMEGROWN)
+        for (long t : ligra_ws::worker_tids())
+            tids.push_back((pid_t)t);
+#endif
+        std::vector<pid_t> r;
+        for (pid_t t : tids)
+            if (t != 0 && std::find(r.begin(), r.end(), t) == r.end())
+                r.push_back(t);
+        return r;
+    }
 
-        perf = (struct perf_struct *)malloc(sizeof(struct perf_struct));
-        if (!perf)
-        {
-            perror("Unable to initialize perf, failed to allocate");
-            exit(errno);
-        }
+    void close_groups(struct perf_struct *perf)
+    {
+        for (struct perf_group &g : perf->groups)
+            for (int fd : g.fd)
+                close(fd);
+        perf->groups.clear();
+    }
 
-        memset(perf, 0, sizeof(struct perf_struct));
+    int open_event(struct perf_event_spec &e, pid_t tid, int group_fd)
+    {
+        struct perf_event_attr pe;
+        memset(&pe, 0, sizeof(pe));
+        pe.type = e.type;
+        pe.size = sizeof(struct perf_event_attr);
+        pe.config = e.config;
+        pe.disabled = group_fd == -1;
+        pe.exclude_user = e.exclude_user;
+        pe.exclude_kernel = e.exclude_kernel;
+        pe.exclude_hv = 1;
+        pe.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+                         PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+#if defined(CILK) || defined(CILKP)
+        pe.inherit = 1;
+#endif
+        return perf_event_open(&pe, tid, -1, group_fd, 0);
+    }
 
-        size_t nr = event_configs.size();
-        perf->nr = nr;
+    // Opens the events on every worker thread. On the first thread the
+    // events are grouped: software events share one group, hardware events
+    // fill groups of up to perf_max_group, and an event the kernel will not
+    // add to a group starts a new one. Groups that do not fit the PMU
+    // together are multiplexed by the kernel; read_counter scales their
+    // counts. If an event cannot be opened at all the counters are disabled
+    // and the run continues with timing only.
+    struct perf_struct *init_perf(std::string event_configs_str)
+    {
+        struct perf_struct *perf = new perf_struct();
 
-        // Instructions
-        perf->pe.type = PERF_TYPE_RAW;
-        perf->pe.size = sizeof(struct perf_event_attr);
-        perf->pe.config = event_configs[0];
+        setlocale(LC_NUMERIC, ""); // For comma seperated printouts
 
-        perf->pe.disabled = 1;
-        perf->pe.exclude_kernel = 1;
-        perf->pe.exclude_hv = 1;
-        perf->pe.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID;
+        perf->events = parse_events(event_configs_str);
+        perf->nr = perf->events.size();
+        perf->leader.assign(perf->nr, 0);
 
-        // TODO for loop for below operations
-        perf->perf_fd[0] = perf_event_open(&perf->pe, 0, -1, -1, 0);
-        if (perf->perf_fd[0] == -1)
-        {
-            fprintf(stderr, "Error opening leader %llx\n", perf->pe.config);
-            fprintf(stderr, "Error code is %d:%s\n", errno, strerror(errno));
-            exit(EXIT_FAILURE);
-        }
-        ioctl(perf->perf_fd[0], PERF_EVENT_IOC_ID, &perf->perf_id[0]);
-
-        if (perf->nr < 2)
-            return perf;
-        // [1] Cycles
-        perf->pe.type = PERF_TYPE_RAW;
-        perf->pe.config = event_configs[1];
-        perf->perf_fd[1] = perf_event_open(&perf->pe, 0, -1, perf->perf_fd[0], 0);
-        if (perf->perf_fd[1] == -1)
+        std::vector<pid_t> tids = worker_tids();
+        for (size_t t = 0; t < tids.size() && perf->nr > 0; t++)
         {
-            fprintf(stderr, "Error opening leader %llx\n", perf->pe.config);
-            fprintf(stderr, "Error code is %d:%s\n", errno, strerror(errno));
-            exit(EXIT_FAILURE);
-        }
-        ioctl(perf->perf_fd[1], PERF_EVENT_IOC_ID, &perf->perf_id[1]);
-
-        if (perf->nr < 3)
-            return perf;
-        // [2] r11D0
-        perf->pe.type = PERF_TYPE_RAW;
-        perf->pe.config = event_configs[2];
-        perf->perf_fd[2] = perf_event_open(&perf->pe, 0, -1, perf->perf_fd[0], 0);
-        if (perf->perf_fd[2] == -1)
-        {
-            fprintf(stderr, "Error opening leader %llx\n", perf->pe.config);
-            fprintf(stderr, "Error code is %d:%s\n", errno, strerror(errno));
-            exit(EXIT_FAILURE);
-        }
-        ioctl(perf->perf_fd[2], PERF_EVENT_IOC_ID, &perf->perf_id[2]);
-
-        if (perf->nr < 4)
-            return perf;
-        // [3] r412e
-        perf->pe.type = PERF_TYPE_RAW;
-        perf->pe.config = event_configs[3];
-        perf->perf_fd[3] = perf_event_open(&perf->pe, 0, -1, perf->perf_fd[0], 0);
-        if (perf->perf_fd[3] == -1)
-        {
-            fprintf(stderr, "Error opening leader %llx\n", perf->pe.config);
-            fprintf(stderr, "Error code is %d:%s\n", errno, strerror(errno));
-            exit(EXIT_FAILURE);
+            struct perf_group g;
+            g.tid = tids[t];
+            long sw = -1, hw = -1;
+            size_t hw_size = 0;
+            for (size_t i = 0; i < perf->nr; i++)
+            {
+                struct perf_event_spec &e = perf->events[i];
+                int fd = -1;
+                if (t > 0)
+                {
+                    size_t l = perf->leader[i];
+                    fd = open_event(e, g.tid, l == i ? -1 : g.fd[l]);
+                }
+                else if (e.type == PERF_TYPE_SOFTWARE)
+                {
+                    fd = open_event(e, g.tid, sw == -1 ? -1 : g.fd[sw]);
+                    if (sw == -1)
+                        sw = i;
+                    perf->leader[i] = sw;
+                }
+                else
+                {
+                    if (hw != -1 && hw_size < perf_max_group)
+                        fd = open_event(e, g.tid, g.fd[hw]);
+                    if (fd != -1)
+                        hw_size++;
+                    else
+                    {
+                        fd = open_event(e, g.tid, -1);
+                        hw = i;
+                        hw_size = 1;
+                    }
+                    perf->leader[i] = hw;
+                }
+                if (fd == -1)
+                {
+                    fprintf(stderr, "chp_perf: cannot open event %s on thread %d: %s, counters disabled\n",
+                            e.name.c_str(), (int)g.tid, strerror(errno));
+                    for (int f : g.fd)
+                        close(f);
+                    close_groups(perf);
+                    perf->nr = 0;
+                    return perf;
+                }
+                unsigned long id;
+                ioctl(fd, PERF_EVENT_IOC_ID, &id);
+                g.fd.push_back(fd);
+                g.id.push_back(id);
+            }
+            perf->groups.push_back(g);
         }
-        ioctl(perf->perf_fd[3], PERF_EVENT_IOC_ID, &perf->perf_id[3]);
-
-        if (perf->nr < 5)
-            return perf;
-        // [4] r4f2e
-        perf->pe.type = PERF_TYPE_RAW;
-        perf->pe.config = event_configs[4];
-        perf->perf_fd[4] = perf_event_open(&perf->pe, 0, -1, perf->perf_fd[0], 0);
-        if (perf->perf_fd[4] == -1)
+        if (perf->nr > 0)
         {
-            fprintf(stderr, "Error opening leader %llx\n", perf->pe.config);
-            fprintf(stderr, "Error code is %d:%s\n", errno, strerror(errno));
-            exit(EXIT_FAILURE);
+            size_t n = 0;
+            for (size_t i = 0; i < perf->nr; i++)
+                n += perf->leader[i] == i;
+            if (n > 1)
+                printf("chp_perf: %zu events in %zu groups per thread\n", perf->nr, n);
         }
-        ioctl(perf->perf_fd[4], PERF_EVENT_IOC_ID, &perf->perf_id[4]);
-
         return perf;
     }
 
     struct counter_arr *init_counters(struct perf_struct *perf)
     {
-        int i;
         struct counter_arr *arr;
         size_t arr_size = sizeof(struct counter_pair) * perf->nr + sizeof(struct counter_arr);
         arr = (struct counter_arr *)malloc(arr_size);
         memset(arr, 0, arr_size);
         arr->nr = perf->nr;
 
-        for (i = 0; i < perf->nr; i++)
+        for (size_t i = 0; i < perf->nr; i++)
         {
-            arr->vals[i].id = perf->perf_id[i];
+            arr->vals[i].id = perf->groups.empty() ? 0 : perf->groups[0].id[i];
         }
 
         return arr;
@@ -201,12 +374,19 @@ extern "C"
 
     void reset_counter(struct perf_struct *perf)
     {
-        ioctl(perf->perf_fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        for (struct perf_group &g : perf->groups)
+            for (size_t i = 0; i < perf->nr; i++)
+                if (perf->leader[i] == i)
+                    ioctl(g.fd[i], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
     }
 
     void start_counter(struct perf_struct *perf)
     {
-        ioctl(perf->perf_fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        traversal_stats::next_round();
+        for (struct perf_group &g : perf->groups)
+            for (size_t i = 0; i < perf->nr; i++)
+                if (perf->leader[i] == i)
+                    ioctl(g.fd[i], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
         perf->startTime = std::chrono::high_resolution_clock::now();
     }
 
@@ -214,31 +394,23 @@ extern "C"
     {
         auto t2 = std::chrono::high_resolution_clock::now();
         perf->duration = std::chrono::duration_cast<std::chrono::nanoseconds>(t2-perf->startTime).count();
-        ioctl(perf->perf_fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
-    }
-
-    void print_counters(unsigned long insts, unsigned long cycle,
-                        unsigned long tlb_miss, unsigned long llc_miss, unsigned long llc_refer)
-    {
-        printf("1:%'15lu\n", insts);
-        printf("2:%'15lu\n", cycle);
-        printf("3:%'15lu\n", tlb_miss);
-        printf("4:%'15lu\n", llc_miss);
-        printf("5:%'15lu\n", llc_refer);
+        for (struct perf_group &g : perf->groups)
+            for (size_t i = 0; i < perf->nr; i++)
+                if (perf->leader[i] == i)
+                    ioctl(g.fd[i], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
     }
 
     void print_aggregate_counter(struct counter_arr *ctrs)
     {
-        print_counters(ctrs->vals[0].val,
-                       ctrs->nr >= 2 ? ctrs->vals[1].val : 0UL,
-                       ctrs->nr >= 3 ? ctrs->vals[2].val : 0UL,
-                       ctrs->nr >= 4 ? ctrs->vals[3].val : 0UL,
-                       ctrs->nr >= 5 ? ctrs->vals[4].val : 0UL);
+        for (size_t i = 0; i < ctrs->nr; i++)
+            printf("%zu:%'15lu\n", i + 1, ctrs->vals[i].val);
     }
 
     struct read_format
     {
         unsigned long nr;
+        unsigned long time_enabled;
+        unsigned long time_running;
         struct
         {
             unsigned long value;
@@ -246,68 +418,317 @@ extern "C"
         } values[];
     };
 
-    void read_counter(struct perf_struct *perf, struct counter_arr *ctrs, std::string output_filename)
+    // Counts of one thread, in the order of the events, with the time each
+    // event's group was enabled and actually running on the PMU.
+    struct perf_values
+    {
+        std::vector<unsigned long> raw, enabled, running;
+
+        // The count extrapolated to the whole enabled time; the plain count
+        // when the group was never multiplexed.
+        double scaled(size_t i) const
+        {
+            if (running[i] == 0)
+                return 0;
+            if (running[i] >= enabled[i])
+                return raw[i];
+            return (double)raw[i] * enabled[i] / running[i];
+        }
+    };
+
+    struct perf_values read_group(struct perf_struct *perf, struct perf_group &g)
     {
+        struct perf_values v;
+        v.raw.assign(perf->nr, 0UL);
+        v.enabled.assign(perf->nr, 0UL);
+        v.running.assign(perf->nr, 0UL);
         struct read_format *buffer;
-        size_t buffer_size = sizeof(*buffer) + sizeof(buffer->values[0]) * 5;
+        size_t buffer_size = sizeof(*buffer) + sizeof(buffer->values[0]) * perf->nr;
         buffer = (struct read_format *)malloc(buffer_size);
-        int read_result = read(perf->perf_fd[0], buffer, buffer_size);
-        if (read_result < 0)
+        for (size_t l = 0; l < perf->nr; l++)
         {
-            std::cout << "Error reading perf file";
+            if (perf->leader[l] != l)
+                continue;
+            if (read(g.fd[l], buffer, buffer_size) < 0)
+            {
+                std::cout << "Error reading perf file of thread " << g.tid << std::endl;
+                continue;
+            }
+            for (size_t i = 0; i < buffer->nr; i++)
+                for (size_t j = 0; j < perf->nr; j++)
+                    if (buffer->values[i].id == g.id[j])
+                    {
+                        v.raw[j] = buffer->values[i].value;
+                        v.enabled[j] = buffer->time_enabled;
+                        v.running[j] = buffer->time_running;
+                    }
         }
+        free(buffer);
+        return v;
+    }
 
-        unsigned long insts = 0UL;
-        unsigned long cycle = 0UL;
-        unsigned long tlb_miss = 0UL;
-        unsigned long llc_miss = 0UL;
-        unsigned long llc_refer = 0UL;
+    // The counts summed over all threads, scaled for multiplexing.
+    std::vector<double> read_totals(struct perf_struct *perf)
+    {
+        std::vector<double> total(perf->nr, 0);
+        for (struct perf_group &g : perf->groups)
+        {
+            struct perf_values v = read_group(perf, g);
+            for (size_t j = 0; j < perf->nr; j++)
+                total[j] += v.scaled(j);
+        }
+        return total;
+    }
 
-        for (int i = 0; i < (int)buffer->nr; i++)
+    // Writes to output_filename:
+    //   the elapsed time,
+    //   the counts summed over all threads, scaled for multiplexing,
+    //   the event names ("events:"),
+    //   the fraction of the enabled time each event was running
+    //     ("running/enabled:", 1 when it was never multiplexed),
+    //   one line of scaled counts per thread.
+    // Also prints the totals with their ratios, and how uneven the first
+    // event is spread over the threads.
+    void read_counter(struct perf_struct *perf, struct counter_arr *ctrs, std::string output_filename)
+    {
+        std::vector<double> total(perf->nr, 0);
+        std::vector<unsigned long> enabled(perf->nr, 0UL), running(perf->nr, 0UL);
+        std::vector<struct perf_values> per_thread;
+        for (struct perf_group &g : perf->groups)
         {
-            if (buffer->values[i].id == perf->perf_id[0])
+            per_thread.push_back(read_group(perf, g));
+            for (size_t j = 0; j < perf->nr; j++)
             {
-                insts = buffer->values[i].value;
-                if (ctrs)
-                    ctrs->vals[0].val += insts;
-            }
-            else if (perf->nr >= 2 && buffer->values[i].id == perf->perf_id[1])
-            {
-                cycle = buffer->values[i].value;
-                if (ctrs)
-                    ctrs->vals[1].val += cycle;
-            }
-            else if (perf->nr >= 3 && buffer->values[i].id == perf->perf_id[2])
-            {
-                tlb_miss = buffer->values[i].value;
-                if (ctrs)
-                    ctrs->vals[2].val += tlb_miss;
-            }
-            else if (perf->nr >= 4 && buffer->values[i].id == perf->perf_id[3])
-            {
-                llc_miss = buffer->values[i].value;
-                if (ctrs)
-                    ctrs->vals[3].val += llc_miss;
-            }
-            else if (perf->nr >= 5 && buffer->values[i].id == perf->perf_id[4])
-            {
-                llc_refer = buffer->values[i].value;
-                if (ctrs)
-                    ctrs->vals[4].val += llc_refer;
+                total[j] += per_thread.back().scaled(j);
+                enabled[j] += per_thread.back().enabled[j];
+                running[j] += per_thread.back().running[j];
             }
         }
-        //print_counters(insts, cycle, tlb_miss, llc_miss, llc_refer);
-        
+        std::vector<double> ratio(perf->nr, 0);
+        for (size_t j = 0; j < perf->nr; j++)
+            ratio[j] = enabled[j] ? (double)running[j] / enabled[j] : 0;
+        if (ctrs)
+            for (size_t j = 0; j < perf->nr && j < ctrs->nr; j++)
+                ctrs->vals[j].val += (unsigned long)total[j];
+
         //Output to file
         ofstream myfile;
         myfile.open (output_filename);
         myfile << perf->duration << "ns\n";
-        myfile << insts << "," << cycle << "," << tlb_miss << "," << llc_miss << "," << llc_refer << "\n"; 
+        for (size_t j = 0; j < perf->nr; j++)
+            myfile << (j ? "," : "") << (unsigned long)total[j];
+        myfile << "\n";
+        myfile << "events:";
+        for (size_t j = 0; j < perf->nr; j++)
+            myfile << (j ? "," : "") << perf->events[j].name;
+        myfile << "\n";
+        myfile << "running/enabled:";
+        for (size_t j = 0; j < perf->nr; j++)
+        {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%.4f", ratio[j]);
+            myfile << (j ? "," : "") << buf;
+        }
+        myfile << "\n";
+        for (size_t t = 0; t < per_thread.size(); t++)
+        {
+            myfile << "thread " << t << " tid " << perf->groups[t].tid << ":";
+            for (size_t j = 0; j < perf->nr; j++)
+                myfile << (j ? "," : "") << (unsigned long)per_thread[t].scaled(j);
+            myfile << "\n";
+        }
         myfile.close();
-        
-        free(buffer);
+
+        for (size_t j = 0; j < perf->nr; j++)
+            printf("%s:%'18.0f (running %.1f%%)\n", perf->events[j].name.c_str(),
+                   total[j], 100 * ratio[j]);
+
+        if (per_thread.size() > 1 && total[0] > 0)
+        {
+            double mx = 0;
+            for (auto &v : per_thread)
+                mx = std::max(mx, v.scaled(0));
+            double mean = total[0] / per_thread.size();
+            printf("chp_perf: %zu threads, %s max/mean per thread = %.2f\n",
+                   per_thread.size(), perf->events[0].name.c_str(), mx / mean);
+        }
+    }
+
+    // Closes the counters of init_perf; apps whose Compute runs many times
+    // (every round, or the benchmark harness) would run out of descriptors.
+    void free_perf(struct perf_struct *perf)
+    {
+        close_groups(perf);
+        delete perf;
     }
 
 #ifdef __cplusplus
 };
 #endif
+
+// **************************************************************
+//    REGIONS (PERF_REGIONS)
+// **************************************************************
+
+// PERF_REGION("name") counts the time and events of the rest of the
+// enclosing scope under name. Regions have their own counter groups on
+// every worker thread, opened by perf_region_init with the events of -e,
+// so they work next to the counters of the app. They are summed per round,
+// per iteration (see stats.h) and per region. Regions entered on a thread
+// other than the one that opened them (inside parallel code) are ignored.
+// Every region is also a trace span (see trace.h); without PERF_REGIONS
+// that is all PERF_REGION does.
+
+#ifdef PERF_REGIONS
+
+struct perf_region_stats
+{
+    long calls = 0;
+    int64_t ns = 0;
+    std::vector<double> counts;
+};
+
+struct perf_region_state
+{
+    struct perf_struct *perf;
+    pid_t tid;
+    std::map<std::tuple<long, long, std::string>, struct perf_region_stats> stats;
+    std::string output_filename;
+};
+
+inline struct perf_region_state *&perf_region_instance()
+{
+    static struct perf_region_state *r = NULL;
+    return r;
+}
+
+inline void perf_region_init(std::string events, std::string output_filename)
+{
+    struct perf_region_state *r = new perf_region_state();
+    r->perf = init_perf(events);
+    r->tid = (pid_t)syscall(SYS_gettid);
+    r->output_filename = output_filename;
+    reset_counter(r->perf);
+    for (struct perf_group &g : r->perf->groups)
+        for (size_t i = 0; i < r->perf->nr; i++)
+            if (r->perf->leader[i] == i)
+                ioctl(g.fd[i], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    perf_region_instance() = r;
+}
+
+inline struct perf_region_state *perf_region_active()
+{
+    static thread_local pid_t tid = (pid_t)syscall(SYS_gettid);
+    struct perf_region_state *r = perf_region_instance();
+#if defined(_OPENMP)
+    if (omp_in_parallel())
+        return NULL;
+#endif
+    return (r != NULL && r->tid == tid) ? r : NULL;
+}
+
+class perf_region_scope
+{
+    struct perf_region_state *r;
+    const char *name;
+    traversal_stats::position pos;
+    std::vector<struct perf_values> start;
+    std::chrono::high_resolution_clock::time_point startTime;
+
+public:
+    perf_region_scope(const char *_name) : r(perf_region_active()), name(_name)
+    {
+        if (r == NULL)
+            return;
+        pos = traversal_stats::current();
+        for (struct perf_group &g : r->perf->groups)
+            start.push_back(read_group(r->perf, g));
+        startTime = std::chrono::high_resolution_clock::now();
+    }
+
+    ~perf_region_scope()
+    {
+        if (r == NULL)
+            return;
+        auto t2 = std::chrono::high_resolution_clock::now();
+        size_t nr = r->perf->nr;
+        struct perf_region_stats &st = r->stats[std::make_tuple(pos.round, pos.iteration, std::string(name))];
+        if (st.counts.size() < nr)
+            st.counts.resize(nr, 0);
+        st.calls++;
+        st.ns += std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - startTime).count();
+        for (size_t t = 0; t < start.size(); t++)
+        {
+            struct perf_values v = read_group(r->perf, r->perf->groups[t]);
+            for (size_t j = 0; j < nr; j++)
+            {
+                double raw = v.raw[j] - start[t].raw[j];
+                unsigned long enabled = v.enabled[j] - start[t].enabled[j];
+                unsigned long running = v.running[j] - start[t].running[j];
+                if (running > 0)
+                    st.counts[j] += (running >= enabled) ? raw : raw * enabled / running;
+            }
+        }
+    }
+};
+
+// Writes one line per round, iteration and region to the output file
+// (round,iteration,region,calls,ns,<events>) and prints the totals of
+// every region.
+inline void perf_region_report()
+{
+    struct perf_region_state *r = perf_region_active();
+    if (r == NULL)
+        return;
+    size_t nr = r->perf->nr;
+    std::map<std::string, struct perf_region_stats> total;
+    ofstream myfile;
+    myfile.open(r->output_filename);
+    myfile << "round,iteration,region,calls,ns";
+    for (size_t j = 0; j < nr; j++)
+        myfile << "," << r->perf->events[j].name;
+    myfile << "\n";
+    for (auto &e : r->stats)
+    {
+        const struct perf_region_stats &st = e.second;
+        myfile << std::get<0>(e.first) << "," << std::get<1>(e.first) << ","
+               << std::get<2>(e.first) << "," << st.calls << "," << st.ns;
+        struct perf_region_stats &tot = total[std::get<2>(e.first)];
+        tot.counts.resize(nr, 0);
+        tot.calls += st.calls;
+        tot.ns += st.ns;
+        for (size_t j = 0; j < nr; j++)
+        {
+            myfile << "," << (unsigned long)st.counts[j];
+            tot.counts[j] += st.counts[j];
+        }
+        myfile << "\n";
+    }
+    myfile.close();
+
+    printf("%-30s %10s %14s", "region", "calls", "ms");
+    for (size_t j = 0; j < nr; j++)
+        printf(" %18s", r->perf->events[j].name.c_str());
+    printf("\n");
+    for (auto &e : total)
+    {
+        printf("%-30s %10ld %14.3f", e.first.c_str(), e.second.calls, e.second.ns / 1e6);
+        for (size_t j = 0; j < nr; j++)
+            printf(" %'18.0f", e.second.counts[j]);
+        printf("\n");
+    }
+    printf("region details written to %s\n", r->output_filename.c_str());
+}
+
+#define PERF_REGION_CAT2(a, b) a##b
+#define PERF_REGION_CAT(a, b) PERF_REGION_CAT2(a, b)
+#define PERF_REGION(name) \
+    perf_region_scope PERF_REGION_CAT(perf_region_, __LINE__)(name); TRACE_SPAN(name)
+
+#else
+
+#define PERF_REGION(name) TRACE_SPAN(name)
+
+#endif
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef CODECS_H
+#define CODECS_H
+
+#include <vector>
+#include "parallel.h"
+#include "utils.h"
+#include "graph.h"
+
+// **************************************************************
+//    ALL EDGE CODECS IN ONE BINARY
+// **************************************************************
+
+// The apps pick one compressed format at compile time (BYTE, NIBBLE,
+// STREAMVBYTE and PD select the codec header compressedVertex.h
+// includes). This header includes all seven once more, each in its own
+// namespace, so that a tool such as apps/CodecBench can encode and decode
+// the same graph with every one of them. The headers share the BYTECODE_H
+// guard and define macros of the same names with different values; both
+// are reset before each header. The macros left defined afterwards are
+// those of nibble-pd.h, which is harmless: the codec compressedVertex.h
+// included has already been parsed. The SIMD intrinsics streamvbyte.h
+// uses are included here, outside the namespaces.
+
+#if defined(__SSSE3__) && !defined(EDGELONG)
+#include <tmmintrin.h>
+#endif
+
+namespace codecs {
+
+#undef BYTECODE_H
+#undef LAST_BIT_SET
+#undef EDGE_SIZE_PER_BYTE
+#undef decode_val_nibblecode
+  namespace bytecode {
+#include "byte.h"
+  }
+
+#undef BYTECODE_H
+#undef LAST_BIT_SET
+#undef EDGE_SIZE_PER_BYTE
+#undef decode_val_nibblecode
+  namespace bytecode_rle {
+#include "byteRLE.h"
+  }
+
+#undef BYTECODE_H
+#undef LAST_BIT_SET
+#undef EDGE_SIZE_PER_BYTE
+#undef decode_val_nibblecode
+  namespace nibblecode {
+#include "nibble.h"
+  }
+
+#undef BYTECODE_H
+#undef LAST_BIT_SET
+#undef EDGE_SIZE_PER_BYTE
+#undef decode_val_nibblecode
+  namespace bytecode_pd {
+#include "byte-pd.h"
+  }
+
+#undef BYTECODE_H
+#undef LAST_BIT_SET
+#undef EDGE_SIZE_PER_BYTE
+#undef decode_val_nibblecode
+  namespace bytecode_rle_pd {
+#include "byteRLE-pd.h"
+  }
+
+#undef BYTECODE_H
+#undef LAST_BIT_SET
+#undef EDGE_SIZE_PER_BYTE
+#undef decode_val_nibblecode
+  namespace nibblecode_pd {
+#include "nibble-pd.h"
+  }
+
+#undef BYTECODE_H
+  namespace streamvbyte {
+#include "streamvbyte.h"
+  }
+
+  // parallelCompressEdges(edges, offsets, n, m, degrees) compresses the
+  // sorted out-edges of each vertex, replaces offsets (n+1 entries) with
+  // byte offsets into the returned array and returns it.
+  typedef uintE* (*compressF)(uintE*, uintT*, long, long, uintE*);
+
+  // decode(t, start, v, degree, par) calls t.srcTarg(v, target, j) for the
+  // edges of v in order; par lets the -pd formats decode the blocks of a
+  // high degree vertex in parallel.
+  template <class T>
+  struct format {
+    const char* name;   // the codec header, without .h
+    compressF compress;
+    void (*decode)(T, uchar*, const uintE&, const uintT&, const bool);
+  };
+
+  // The unweighted codecs, for a functor type T. T must not live in the
+  // global namespace, where argument dependent lookup would also find the
+  // functions of the codec compressedVertex.h included.
+  template <class T>
+  std::vector<format<T> > all() {
+    return {
+      {"byte", bytecode::parallelCompressEdges, bytecode::decode<T>},
+      {"byteRLE", bytecode_rle::parallelCompressEdges, bytecode_rle::decode<T>},
+      {"nibble", nibblecode::parallelCompressEdges, nibblecode::decode<T>},
+      {"byte-pd", bytecode_pd::parallelCompressEdges, bytecode_pd::decode<T>},
+      {"byteRLE-pd", bytecode_rle_pd::parallelCompressEdges, bytecode_rle_pd::decode<T>},
+      {"nibble-pd", nibblecode_pd::parallelCompressEdges, nibblecode_pd::decode<T>},
+      {"streamvbyte", streamvbyte::parallelCompressEdges, streamvbyte::decode<T>},
+    };
+  }
+}
+
+#endif
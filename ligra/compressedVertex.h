@@ -1,7 +1,9 @@
 #ifndef COMPRESSED_VERTEX_H
 #define COMPRESSED_VERTEX_H
 
-#ifndef PD
+#ifdef STREAMVBYTE
+#include "streamvbyte.h"
+#elif !defined PD
 #ifdef BYTE
 #include "byte.h"
 #elif defined NIBBLE
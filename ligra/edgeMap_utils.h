@@ -23,10 +23,19 @@ auto get_emdense_gen(tuple<bool, data>* next) {
     if (m.exists) next[ngh] = make_tuple(1, m.t); };
 }
 
+// Marks ngh in a plain bitmap. A named type rather than a lambda: the
+// result is captured by the lambdas of the edgeMap loops, and a lambda
+// returned by a non-template function has no linkage
+// (-Wsubobject-linkage).
+struct emdense_bitmap_gen {
+  bool* next;
+  inline void operator() (uintE ngh, bool m=false) const {
+    if (m) next[ngh] = 1; }
+};
+
 //new simpler versoin of edgeMapDense
-auto get_emdense_gen(bool* next) {
-  return [next] (uintE ngh, bool m=false) {
-    if (m) next[ngh] = 1; };
+inline emdense_bitmap_gen get_emdense_gen(bool* next) {
+  return emdense_bitmap_gen{next};
 }
 
 // Standard version of edgeMapDenseForward.
@@ -45,9 +54,8 @@ auto get_emdense_forward_gen(tuple<bool, data>* next) {
 }
 
 // new simpler version of edgeMapDenseForward.
-auto get_emdense_forward_gen(bool* next) {
-  return [next] (uintE ngh, bool m=false) {
-    if (m) next[ngh] = 1; };
+inline emdense_bitmap_gen get_emdense_forward_gen(bool* next) {
+  return emdense_bitmap_gen{next};
 }
 
 // Standard version of edgeMapSparse.
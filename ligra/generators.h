@@ -0,0 +1,255 @@
+#ifndef GENERATORS_H
+#define GENERATORS_H
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "parallel.h"
+#include "utils.h"
+#include "parseCommandLine.h"
+#include "timer.h"
+#include "trace.h"
+// intPair, getFirst and ParallelPrefixSum come from IO.h, which has no
+// include guard; ligra.h includes it before this file.
+
+// **************************************************************
+//    GRAPH GENERATORS (-gen)
+// **************************************************************
+
+// With -gen <kind> the apps build their graph in memory instead of reading
+// the input file, whose name is then only a label:
+//
+//   rmat  - recursive matrix (Chakrabarti et al.) over -gen_n vertices,
+//           a, b, c = .5, .1, .1 as the PBBS rMatGraph generator.
+//   kron  - Graph500 Kronecker: 2^-gen_scale vertices, a, b, c = .57, .19,
+//           .19, with the vertex ids scrambled.
+//   er    - uniform (Erdos-Renyi) endpoints.
+//   grid2 - 2D grid of side floor(sqrt(n)), grid3 3D grid of side
+//           floor(cbrt(n)); always symmetric, high diameter like road networks.
+//
+// -gen_scale s sets n to 2^s (-gen_n sets it directly, 2^20 by default),
+// -gen_m the number of generated edges (-gen_edgefactor times n, 16 by
+// default), -gen_a/-gen_b/-gen_c the rmat/kron probabilities and -gen_seed
+// the seed (1). Edge i is a function of the seed and i only, so a graph is
+// the same for any number of workers. rmat, kron and er are directed unless
+// -s is given, which adds the reverse of every edge. Duplicate edges and
+// self-loops are removed, as readGraph does, so the final edge count is below
+// the generated one. With -gen_write the graph is written in the binary
+// format (<inFile>.config, .adj and .idx, read back with -b) and the app
+// exits without running.
+
+namespace generators {
+
+#ifndef WEIGHTED
+  struct spec {
+    std::string kind;
+    long n, m;      // vertices and generated edges
+    int scale;      // bits of the id space of rmat and kron
+    long side;      // grid side
+    double a, b, c;
+    ulong seed;
+  };
+
+  // Out-edges in compressed sparse row form; offsets has n+1 entries.
+  struct csr { long n, m; uintT* offsets; uintE* edges; };
+
+  inline ulong random(ulong seed, ulong i) { return hashInt(hashInt(seed) + i); }
+
+  // The top 53 bits of r as a double in [0, 1).
+  inline double unit(ulong r) { return (r >> 11) * (1.0 / 9007199254740992.0); }
+
+  // A bijection of [0, 2^bits) (odd multipliers and xorshifts), so that the
+  // high degree vertices of a Kronecker graph do not get the low ids.
+  inline ulong scramble(ulong x, int bits, ulong seed) {
+    ulong mask = bits >= 64 ? ~0UL : (1UL << bits) - 1;
+    ulong k = hashInt(seed) | 1;
+    for (int round = 0; round < 2; round++) {
+      x = (x * k) & mask;
+      x ^= x >> ((bits + 1) / 2);
+      k = hashInt(k) | 1;
+    }
+    return x & mask;
+  }
+
+  // One edge of a recursive matrix: each of the scale levels picks a
+  // quadrant with probabilities a, b, c and 1-a-b-c.
+  inline intPair rmatEdge(const spec& s, ulong i) {
+    ulong r = random(s.seed, i);
+    ulong u = 0, v = 0;
+    for (int l = 0; l < s.scale; l++) {
+      double x = unit(r);
+      r = hashInt(r);
+      u <<= 1; v <<= 1;
+      if (x < s.a) continue;
+      else if (x < s.a + s.b) v |= 1;
+      else if (x < s.a + s.b + s.c) u |= 1;
+      else { u |= 1; v |= 1; }
+    }
+    if (s.kind == "kron") { u = scramble(u, s.scale, s.seed); v = scramble(v, s.scale, s.seed); }
+    return intPair(u % s.n, v % s.n);
+  }
+
+  // Dimensions of a grid, 0 for the random kinds.
+  inline int dimensions(const spec& s) {
+    return s.kind == "grid2" ? 2 : s.kind == "grid3" ? 3 : 0;
+  }
+
+  // Generated edge i. Grid edge i joins vertex i/d to its next neighbor in
+  // dimension i%d; on the border it is a self-loop, which is dropped later.
+  inline intPair edge(const spec& s, long i) {
+    int d = dimensions(s);
+    if (d > 0) {
+      long v = i / d, stride = 1;
+      for (int k = 0; k < i % d; k++) stride *= s.side;
+      bool inside = (v / stride) % s.side + 1 < s.side;
+      return intPair(v, inside ? v + stride : v);
+    }
+    if (s.kind == "er") return intPair(random(s.seed, 2 * i) % s.n, random(s.seed, 2 * i + 1) % s.n);
+    return rmatEdge(s, i);
+  }
+
+  // Sorts the k pairs by source and target and keeps the distinct pairs
+  // that are not self-loops, as the out-edges of n vertices.
+  inline csr fromPairs(long n, intPair* E, long k) {
+    csr g;
+    g.n = n;
+    intSort::iSort(E, k, n + 1, getFirst<uintE>());
+    uintT* start = newA(uintT, n);
+    {par_for(0, n, 0, [&] (long i) { start[i] = INT_T_MAX; });}
+    {par_for(0, k, 0, [&] (long i) {
+      if (i == 0 || E[i].first != E[i-1].first) start[E[i].first] = i; });}
+    // vertices without edges start where the next vertex with edges does
+    sequence::scanIBack(start, start, n, minF<uintT>(), (uintT) k);
+    pvector<uintT> degrees(n);
+    {par_for(0, n, 0, [&] (long v) {
+      long o = start[v], e = (v == n - 1) ? k : start[v + 1], w = o;
+      std::sort(E + o, E + e);
+      for (long j = o; j < e; j++)
+        if (E[j].second != (uintE) v && (j == o || E[j].second != E[j-1].second)) E[w++] = E[j];
+      degrees[v] = w - o;
+    });}
+    pvector<uintT> offsets = ParallelPrefixSum(degrees);
+    g.m = offsets[n];
+    g.offsets = newA(uintT, n + 1);
+    g.edges = newA(uintE, std::max(1L, g.m));
+    MEM_TAG(g.offsets, "gen/offsets");
+    MEM_TAG(g.edges, "gen/edges");
+    {par_for(0, n + 1, 0, [&] (long v) { g.offsets[v] = offsets[v]; });}
+    {par_for(0, n, 0, [&] (long v) {
+      for (uintT j = 0; j < degrees[v]; j++) g.edges[offsets[v] + j] = E[start[v] + j].second; });}
+    free(start);
+    return g;
+  }
+
+  inline spec fromOptions(commandLine P) {
+    spec s;
+    s.kind = P.getOptionValue("-gen", "");
+    if (s.kind != "rmat" && s.kind != "kron" && s.kind != "er" && s.kind != "grid2" &&
+        s.kind != "grid3") {
+      std::cout << "unknown -gen " << s.kind << ", use rmat, kron, er, grid2 or grid3" << std::endl;
+      abort();
+    }
+    int scale = P.getOptionIntValue("-gen_scale", 0);
+    s.n = std::max(1L, P.getOptionLongValue("-gen_n", 1L << (scale > 0 ? scale : 20)));
+    s.scale = 0;
+    while ((1L << s.scale) < s.n) s.scale++;
+    if (s.kind == "kron") s.n = 1L << s.scale;
+    s.side = 0;
+    if (s.kind == "grid2") { s.side = std::max(1L, (long) sqrt((double) s.n)); s.n = s.side * s.side; }
+    if (s.kind == "grid3") {
+      s.side = std::max(1L, (long) cbrt((double) s.n));
+      while ((s.side + 1) * (s.side + 1) * (s.side + 1) <= s.n) s.side++;
+      s.n = s.side * s.side * s.side;
+    }
+    s.m = P.getOptionLongValue("-gen_m", P.getOptionLongValue("-gen_edgefactor", 16) * s.n);
+    if (dimensions(s) > 0) s.m = s.n * dimensions(s);
+    bool kron = (s.kind == "kron");
+    s.a = P.getOptionDoubleValue("-gen_a", kron ? .57 : .5);
+    s.b = P.getOptionDoubleValue("-gen_b", kron ? .19 : .1);
+    s.c = P.getOptionDoubleValue("-gen_c", kron ? .19 : .1);
+    s.seed = P.getOptionLongValue("-gen_seed", 1);
+    return s;
+  }
+
+  // The out-edges of the graph -gen describes; symmetric (or a grid) adds
+  // the reverse of every generated edge.
+  inline csr generate(commandLine P, bool symmetric) {
+    TRACE_SPAN("generate");
+    Timer t;
+    t.Start();
+    spec s = fromOptions(P);
+    bool both = symmetric || dimensions(s) > 0;
+    long k = both ? 2 * s.m : s.m;
+    intPair* E = newA(intPair, std::max(1L, k));
+    MEM_TAG(E, "gen/pairs");
+    {par_for(0, s.m, 0, [&] (long i) {
+      intPair e = edge(s, i);
+      E[i] = e;
+      if (both) E[s.m + i] = intPair(e.second, e.first);
+    });}
+    csr g = fromPairs(s.n, E, k);
+    free(E);
+    t.Stop();
+    t.PrintTime("Graph generation time(s)", t.Seconds());
+    std::cout << "Generated " << s.kind << " graph. Num Nodes = " << g.n << " and Num Edges = "
+              << g.m << "\n";
+    return g;
+  }
+
+  // Writes g as name.config (n), name.adj (the edges) and name.idx (the
+  // offsets), the files readGraphFromBinary reads.
+  inline void writeBinary(const csr& g, const std::string& name) {
+    std::ofstream config(name + ".config");
+    config << g.n;
+    std::ofstream adj(name + ".adj", std::ios::binary);
+    adj.write((const char*) g.edges, sizeof(uintE) * g.m);
+    std::ofstream idx(name + ".idx", std::ios::binary);
+    idx.write((const char*) g.offsets, sizeof(uintT) * g.n);
+    if (!config || !adj || !idx) std::cout << "cannot write " << name << ".{config,adj,idx}" << std::endl;
+    else std::cout << "Wrote " << name << ".config, .adj and .idx" << std::endl;
+  }
+
+  inline void emit(commandLine P, const char* name, bool symmetric) {
+    csr g = generate(P, symmetric);
+    writeBinary(g, name);
+    free(g.offsets);
+    free(g.edges);
+  }
+
+  // The generated graph; a directed graph also gets its in-edges.
+  template <class vertex>
+  graph<vertex> generateGraph(commandLine P, bool symmetric) {
+    csr out = generate(P, symmetric);
+    long n = out.n, m = out.m;
+    vertex* v = newA(vertex, n);
+    MEM_TAG(v, "vertices");
+    {par_for(0, n, 0, [&] (long i) {
+      v[i].setOutDegree(out.offsets[i + 1] - out.offsets[i]);
+      v[i].setOutNeighbors(out.edges + out.offsets[i]);
+    });}
+    if (symmetric) {
+      free(out.offsets);
+      Uncompressed_Mem<vertex>* mem = new Uncompressed_Mem<vertex>(v, n, m, out.edges);
+      return graph<vertex>(v, n, m, mem);
+    }
+    intPair* T = newA(intPair, std::max(1L, m));
+    {par_for(0, n, 0, [&] (long i) {
+      for (uintT j = out.offsets[i]; j < out.offsets[i + 1]; j++) T[j] = intPair(out.edges[j], i); });}
+    csr in = fromPairs(n, T, m);
+    free(T);
+    {par_for(0, n, 0, [&] (long i) {
+      v[i].setInDegree(in.offsets[i + 1] - in.offsets[i]);
+      v[i].setInNeighbors(in.edges + in.offsets[i]);
+    });}
+    free(out.offsets);
+    free(in.offsets);
+    Uncompressed_Mem<vertex>* mem = new Uncompressed_Mem<vertex>(v, n, m, out.edges, in.edges);
+    return graph<vertex>(v, n, m, mem);
+  }
+#endif
+}
+
+#endif
@@ -3,9 +3,13 @@
 #include <iostream>
 #include <fstream>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include "vertex.h"
 #include "compressedVertex.h"
 #include "parallel.h"
+#include "sequence.h"
+#include "allocator.h"
+#include "trace.h"
 using namespace std;
 
 // **************************************************************
@@ -44,13 +48,38 @@ struct Compressed_Mem : public Deletable {
 public:
   vertex* V;
   char* s;
+  size_t mapped;  // length of the mapping s points into, 0 when s was allocated
 
-  Compressed_Mem(vertex* _V, char* _s) :
-                 V(_V), s(_s) { }
+  Compressed_Mem(vertex* _V, char* _s, size_t _mapped = 0) :
+                 V(_V), s(_s), mapped(_mapped) { }
 
   void del() {
     free(V);
-    free(s);
+    if (mapped > 0) munmap(s, mapped);
+    else free(s);
+  }
+};
+
+// Per NUMA node copies of the vertex array and of the edge arrays it points
+// to. Replica k lives entirely on the memory node in slot k.
+template <class vertex>
+struct Replica_Mem : public Deletable {
+public:
+  vertex** V;
+  void** edges;
+  int k;
+
+  Replica_Mem(int _k) : k(_k) {
+    V = newA(vertex*, k);
+    edges = newA(void*, 2*k);
+    for (int i=0; i < k; i++) { V[i] = NULL; edges[2*i] = edges[2*i+1] = NULL; }
+  }
+
+  void del() {
+    for (int i=0; i < k; i++) {
+      free(V[i]); free(edges[2*i]); free(edges[2*i+1]);
+    }
+    free(V); free(edges);
   }
 };
 
@@ -62,25 +91,90 @@ struct graph {
   bool transposed;
   uintE* flags;
   Deletable *D;
+  Replica_Mem<vertex> *R;
 
 graph(vertex* _V, long _n, long _m, Deletable* _D) : V(_V), n(_n), m(_m),
-  D(_D), flags(NULL), transposed(0) {}
+  D(_D), flags(NULL), transposed(0), R(NULL) {}
 
 graph(vertex* _V, long _n, long _m, Deletable* _D, uintE* _flags) : V(_V),
-  n(_n), m(_m), D(_D), flags(_flags), transposed(0) {}
+  n(_n), m(_m), D(_D), flags(_flags), transposed(0), R(NULL) {}
 
   void del() {
     if (flags != NULL) free(flags);
+    if (R != NULL) { R->del(); delete R; R = NULL; }
     D->del();
     free(D);
   }
 
+  bool replicated() const { return R != NULL; }
+
+  // Vertex array to read from on the calling thread: the replica on the
+  // thread's NUMA node when the graph is replicated, else V.
+  vertex* localV() const {
+    return (R == NULL) ? V : R->V[numa::localSlot()];
+  }
+
+  // Copies the vertices and edges into one replica per memory node. The
+  // replicas are read-only: edgeMap reads through localV(), but anything
+  // that mutates adjacency lists (packEdges) works on V only. Only defined
+  // for uncompressed vertices.
+  void replicate() {
+    if (R != NULL) return;
+    TRACE_SPAN("replicate");
+    int k = numa::numNodes();
+#ifndef WEIGHTED
+    typedef uintE E;
+    const long w = 1;
+#else
+    typedef intE E;
+    const long w = 2;
+#endif
+    bool asym = (sizeof(vertex) == sizeof(asymmetricVertex));
+    uintT* outOff = newA(uintT, n+1);
+    uintT* inOff = newA(uintT, n+1);
+    {par_for(0, n, 0, [&] (long i) {
+      outOff[i] = V[i].getOutDegree();
+      inOff[i] = asym ? V[i].getInDegree() : 0;
+    });}
+    outOff[n] = sequence::plusScan(outOff, outOff, n);
+    inOff[n] = sequence::plusScan(inOff, inOff, n);
+    R = new Replica_Mem<vertex>(k);
+    for (int r=0; r < k; r++) {
+      vertex* RV = (vertex*) allocArrayOnNode(n*sizeof(vertex), r);
+      E* out = (E*) allocArrayOnNode(w*outOff[n]*sizeof(E), r);
+      E* in = asym ? (E*) allocArrayOnNode(w*inOff[n]*sizeof(E), r) : NULL;
+      {par_for(0, n, 0, [&] (long i) {
+        RV[i] = V[i];
+        E* o = (E*) V[i].getOutNeighbors();
+        long d = w*V[i].getOutDegree();
+        for (long j=0; j < d; j++) out[w*outOff[i]+j] = o[j];
+        RV[i].setOutNeighbors(out + w*outOff[i]);
+        if (asym) {
+          E* ii = (E*) V[i].getInNeighbors();
+          d = w*V[i].getInDegree();
+          for (long j=0; j < d; j++) in[w*inOff[i]+j] = ii[j];
+          RV[i].setInNeighbors(in + w*inOff[i]);
+        }
+      });}
+      R->V[r] = RV; R->edges[2*r] = out; R->edges[2*r+1] = in;
+    }
+    long bytes = n*sizeof(vertex) + w*(outOff[n]+inOff[n])*sizeof(E);
+    free(outOff); free(inOff);
+    cout << "Replicated graph on " << k << " node(s), "
+         << bytes/(1<<20) << " MB per replica" << endl;
+  }
+
   void transpose() {
     if ((sizeof(vertex) == sizeof(asymmetricVertex)) ||
         (sizeof(vertex) == sizeof(compressedAsymmetricVertex))) {
-      parallel_for(long i=0;i<n;i++) {
+      par_for(0, n, 0, [&] (long i) {
         V[i].flipEdges();
-      }
+      });
+      if (R != NULL)
+        for (int r=0; r < R->k; r++) {
+          vertex* RV = R->V[r];
+          par_for(0, n, 0, [&] (long i) { RV[i].flipEdges(); });
+        }
       transposed = !transposed;
     }
   }
@@ -39,11 +39,16 @@
 #include "vertexSubset.h"
 #include "graph.h"
 #include "IO.h"
+#include "generators.h"
+#include "verify.h"
 #include "parseCommandLine.h"
 #include "gettime.h"
 #include "index_map.h"
 #include "edgeMap_utils.h"
 #include "sliding_queue.h"
+#include "affinity.h"
+#include "stats.h"
+#include "chp_perf.h"
 using namespace std;
 
 //*****START FRAMEWORK*****
@@ -56,33 +61,33 @@ const flags dense_forward = 8;
 const flags dense_parallel = 16;
 const flags remove_duplicates = 32;
 inline bool should_output(const flags& fl) { return !(fl & no_output); }
-const int dynChunkSz = 64; //chunk size for openmp's dynamic scheduling
+const int dynChunkSz = 64; //grain of the edgeMap loops (chunk size under openmp)
 
 template <class data, class vertex, class VS, class F>
 vertexSubsetData<data> edgeMapDense(graph<vertex> GA, VS& vertexSubset, bool* nextBitmap, F &f, const flags fl) {
+  PERF_REGION("edgeMapDense/traverse");
   //using D = tuple<bool, data>;
   long n = GA.n;
-  vertex *G = GA.V;
   if (should_output(fl)) {
     //D* next = newA(D, n);
     auto g = get_emdense_gen(nextBitmap);
-    #pragma omp parallel for schedule (dynamic, dynChunkSz)
-    for (long v=0; v<n; v++) {
+    traversal_stats::node_loop_for(n, dynChunkSz, [&] (long v) {
       //std::get<0>(nextBitmap[v]) = 0;
       nextBitmap[v] = 0;
       if (f.cond(v)) {
-        G[v].decodeInNghBreakEarly(v, vertexSubset, f, g, fl & dense_parallel);
+        GA.localV()[v].decodeInNghBreakEarly(v, vertexSubset, f, g, fl & dense_parallel);
       }
-    }
+    }, [&] (long v) { return GA.V[v].getInDegree(); },
+    [&] (long v) { return (uintptr_t) GA.V[v].getInNeighbors(); });
     return vertexSubsetData<data>(n, nextBitmap);
   } else {
     auto g = get_emdense_nooutput_gen<data>();
-    #pragma omp parallel for schedule (dynamic, dynChunkSz)
-    for (long v=0; v<n; v++) {
+    traversal_stats::node_loop_for(n, dynChunkSz, [&] (long v) {
       if (f.cond(v)) {
-        G[v].decodeInNghBreakEarly(v, vertexSubset, f, g, fl & dense_parallel);
+        GA.localV()[v].decodeInNghBreakEarly(v, vertexSubset, f, g, fl & dense_parallel);
       }
-    }
+    }, [&] (long v) { return GA.V[v].getInDegree(); },
+    [&] (long v) { return (uintptr_t) GA.V[v].getInNeighbors(); });
     return vertexSubsetData<data>(n);
   }
 }
@@ -91,28 +96,30 @@ template <class data, class vertex, class VS, class F>
 vertexSubsetData<data> edgeMapDenseForward(graph<vertex> GA, VS& vertexSubset, bool* nextBitmap, F &f, const flags fl) {
   //using D = tuple<bool, data>;
   long n = GA.n;
-  vertex *G = GA.V;
   if (should_output(fl)) {
     //D* next = newA(D, n);
     //auto g = get_emdense_forward_gen<data>(next);
     auto g = get_emdense_forward_gen(nextBitmap);
     //parallel_for(long i=0;i<n;i++) { std::get<0>(next[i]) = 0; }
-    parallel_for(long i=0;i<n;i++) { nextBitmap[i] = 0; }
-    #pragma omp parallel for schedule (dynamic, dynChunkSz)
-    for (long i=0; i<n; i++) {
+    {PERF_REGION("edgeMapDenseForward/clear");
+    par_for(0, n, 0, [&] (long i) { nextBitmap[i] = 0; });}
+    PERF_REGION("edgeMapDenseForward/traverse");
+    traversal_stats::node_loop_for(n, dynChunkSz, [&] (long i) {
       if (vertexSubset.isIn(i)) {
-        G[i].decodeOutNgh(i, f, g);
+        GA.localV()[i].decodeOutNgh(i, f, g);
       }
-    }
+    }, [&] (long i) { return vertexSubset.isIn(i) ? GA.V[i].getOutDegree() : 0; },
+    [&] (long i) { return (uintptr_t) GA.V[i].getOutNeighbors(); });
     return vertexSubsetData<data>(n, nextBitmap);
   } else {
     auto g = get_emdense_forward_nooutput_gen<data>();
-    #pragma omp parallel for schedule (dynamic, dynChunkSz)
-    for (long i=0; i<n; i++) {
+    PERF_REGION("edgeMapDenseForward/traverse");
+    traversal_stats::node_loop_for(n, dynChunkSz, [&] (long i) {
       if (vertexSubset.isIn(i)) {
-        G[i].decodeOutNgh(i, f, g);
+        GA.localV()[i].decodeOutNgh(i, f, g);
       }
-    }
+    }, [&] (long i) { return vertexSubset.isIn(i) ? GA.V[i].getOutDegree() : 0; },
+    [&] (long i) { return (uintptr_t) GA.V[i].getOutNeighbors(); });
     return vertexSubsetData<data>(n);
   }
 }
@@ -127,24 +134,28 @@ vertexSubsetData<data> edgeMapSparse(graph<vertex>& GA, vertex* frontierVertices
   if (should_output(fl)) {
     auto g = get_emdense_forward_gen(nextBitmap);
     //parallel_for(long i=0;i<n;++i) { std::get<0>(next[i]) = 0; }
-    parallel_for(long i=0;i<n;++i) { nextBitmap[i] = 0; }
-    #pragma omp parallel for schedule (dynamic, dynChunkSz)
-    for (size_t i = 0; i < m; i++) {
+    {PERF_REGION("edgeMapSparse/clear");
+    par_for(0, n, 0, [&] (long i) { nextBitmap[i] = 0; });}
+    PERF_REGION("edgeMapSparse/traverse");
+    traversal_stats::loop_for(m, dynChunkSz, [&] (size_t i) {
       uintT v = indices.vtx(i);
-      vertex vert = frontierVertices[i];
+      // frontierVertices were gathered from GA.V; read the local replica instead
+      vertex vert = GA.replicated() ? GA.localV()[v] : frontierVertices[i];
       vert.decodeOutNgh(v, f, g);
-    }
+    }, [&] (size_t i) { return degrees[i]; });
   } else {
     auto g = get_emsparse_nooutput_gen<data>();
-    #pragma omp parallel for schedule (dynamic, dynChunkSz)
-    for (size_t i = 0; i < m; i++) {
+    PERF_REGION("edgeMapSparse/traverse");
+    traversal_stats::loop_for(m, dynChunkSz, [&] (size_t i) {
       uintT v = indices.vtx(i);
-      vertex vert = frontierVertices[i];
+      vertex vert = GA.replicated() ? GA.localV()[v] : frontierVertices[i];
       vert.decodeOutNghSparse(v, 0, f, g);
-    }
+    }, [&] (size_t i) { return degrees[i]; });
   }
 
   if (should_output(fl)) {
+    PERF_REGION("edgeMapSparse/pack");
+#if defined(OPENMP)
     long frontSz {0};
     SlidingQueue<uintT> queue(GA.n);
     #pragma omp parallel
@@ -164,14 +175,21 @@ vertexSubsetData<data> edgeMapSparse(graph<vertex>& GA, vertex* frontierVertices
     queue.slide_window();
     free(nextBitmap); 
     assert(frontSz == queue.size());
+    uintT* next = queue.begin();
+#else
+    // the per-thread queues above need an OpenMP team; pack the bitmap
+    _seq<uintT> packed = sequence::packIndex<uintT>(nextBitmap, (uintT) GA.n);
+    free(nextBitmap);
+    long frontSz = packed.n;
+    uintT* next = packed.A;
+#endif
     S* nextIndices = newA(S, frontSz); 
-    #pragma omp parallel for
-    for (auto q_iter = queue.begin(); q_iter < queue.end(); ++q_iter)
-    {
-        int index  = q_iter - queue.begin();
-        uintT vtx = *q_iter;
-        std::get<0>(nextIndices[index]) = vtx;
-    }
+    par_for(0, frontSz, 0, [&] (long index) {
+        std::get<0>(nextIndices[index]) = next[index];
+    });
+#if !defined(OPENMP)
+    packed.del();
+#endif
     if (fl & remove_duplicates) {
         assert(false);
     }
@@ -202,13 +220,12 @@ vertexSubsetData<data> edgeMapSparse_no_filter(graph<vertex>& GA,
 
   auto offsets_m = make_in_imap<uintT>(m, [&] (size_t i) { return offsets[i]; });
   auto lt = [] (const uintT& l, const uintT& r) { return l < r; };
-  parallel_for(size_t i=0; i<n_blocks; i++) {
+  par_for(0, n_blocks, 0, [&] (size_t i) {
     size_t s_val = i*b_size;
     block_offs[i] = pbbs::binary_search(offsets_m, s_val, lt);
-  }
+  });
   block_offs[n_blocks] = m;
-  #pragma omp parallel for schedule (dynamic, dynChunkSz / 8)
-  for (size_t i=0; i<n_blocks; i++) {
+  par_for(0, n_blocks, dynChunkSz / 8, [&] (size_t i) {
     if ((i == n_blocks-1) || block_offs[i] != block_offs[i+1]) {
       // start and end are offsets in [m]
       size_t start = block_offs[i];
@@ -224,14 +241,14 @@ vertexSubsetData<data> edgeMapSparse_no_filter(graph<vertex>& GA,
     } else {
       cts[i] = 0;
     }
-  }
+  });
 
   long outSize = sequence::plusScan(cts, cts, n_blocks);
   cts[n_blocks] = outSize;
 
   S* out = newA(S, outSize);
 
-  parallel_for (size_t i=0; i<n_blocks; i++) {
+  par_for(0, n_blocks, 0, [&] (size_t i) {
     if ((i == n_blocks-1) || block_offs[i] != block_offs[i+1]) {
       size_t start = block_offs[i];
       size_t start_o = offsets[start];
@@ -241,13 +258,13 @@ vertexSubsetData<data> edgeMapSparse_no_filter(graph<vertex>& GA,
         out[out_off + j] = outEdges[start_o + j];
       }
     }
-  }
+  });
   free(outEdges); free(cts); free(block_offs);
 
   if (fl & remove_duplicates) {
     if (GA.flags == NULL) {
       GA.flags = newA(uintE, n);
-      parallel_for(size_t i=0;i<n;i++) { GA.flags[i]=UINT_E_MAX; }
+      par_for(0, n, 0, [&] (size_t i) { GA.flags[i]=UINT_E_MAX; });
     }
     auto get_key = [&] (size_t i) -> uintE& { return std::get<0>(out[i]); };
     remDuplicates(get_key, GA.flags, outSize, n);
@@ -261,10 +278,11 @@ vertexSubsetData<data> edgeMapSparse_no_filter(graph<vertex>& GA,
 }
 
 // Decides on sparse or dense base on number of nonzeros in the active vertices.
+// rec, when not NULL, gets the out-degree sum and the choice made.
 template <class data, class vertex, class VS, class F>
-vertexSubsetData<data> edgeMapData(graph<vertex>& GA, VS &vs, 
-    bool* nextBitmap, F f,
-    intT threshold = -1, const flags& fl=0) {
+vertexSubsetData<data> edgeMapDataCore(graph<vertex>& GA, VS &vs,
+    bool* nextBitmap, F f, intT threshold, const flags& fl,
+    traversal_stats::record* rec) {
   long numVertices = GA.n, numEdges = GA.m, m = vs.numNonzeros();
   if(threshold == -1) threshold = numEdges/20; //default threshold
   vertex *G = GA.V;
@@ -273,25 +291,33 @@ vertexSubsetData<data> edgeMapData(graph<vertex>& GA, VS &vs,
     abort();
   }
   if (vs.size() == 0) return vertexSubsetData<data>(numVertices);
+  uintT* degrees;
+  vertex* frontierVertices;
+  uintT outDegrees;
+  {PERF_REGION("edgeMapData/prepare");
   vs.toSparse();
-  uintT* degrees = newA(uintT, m);
-  vertex* frontierVertices = newA(vertex,m);
-  {parallel_for (size_t i=0; i < m; i++) {
+  degrees = newA(uintT, m);
+  frontierVertices = newA(vertex,m);
+  {par_for(0, m, 0, [&] (size_t i) {
     uintE v_id = vs.vtx(i);
     vertex v = G[v_id];
     degrees[i] = v.getOutDegree();
     frontierVertices[i] = v;
-  }}
+  });}
 
-  uintT outDegrees = sequence::plusReduce(degrees, m);
+  outDegrees = sequence::plusReduce(degrees, m);}
+  if (rec != NULL) rec->outDegrees = outDegrees;
+  traversal_stats::examined() += outDegrees;
   if (outDegrees == 0) return vertexSubsetData<data>(numVertices);
   if (m + outDegrees > threshold) {
+    if (rec != NULL) rec->mode = (fl & dense_forward) ? "dense_forward" : "dense";
     vs.toDense();
     free(degrees); free(frontierVertices);
     return (fl & dense_forward) ?
       edgeMapDenseForward<data, vertex, VS, F>(GA, vs, nextBitmap, f, fl) :
       edgeMapDense<data, vertex, VS, F>(GA, vs, nextBitmap, f, fl);
   } else {
+    if (rec != NULL) rec->mode = "sparse";
     auto vs_out =
       (should_output(fl) && fl & sparse_no_filter) ? // only call snof when we output
       edgeMapSparse_no_filter<data, vertex, VS, F>(GA, frontierVertices, vs, nextBitmap, degrees, vs.numNonzeros(), f, fl) :
@@ -301,6 +327,27 @@ vertexSubsetData<data> edgeMapData(graph<vertex>& GA, VS &vs,
   }
 }
 
+template <class data, class vertex, class VS, class F>
+vertexSubsetData<data> edgeMapData(graph<vertex>& GA, VS &vs,
+    bool* nextBitmap, F f,
+    intT threshold = -1, const flags& fl=0) {
+  traversal_stats::next_iteration();
+  PERF_REGION("edgeMapData");
+  if (!traversal_stats::enabled()) {
+    if (traversal_stats::collector() == NULL)
+      return edgeMapDataCore<data>(GA, vs, nextBitmap, f, threshold, fl, NULL);
+    traversal_stats::record rec(vs.numNonzeros());
+    auto vs_out = edgeMapDataCore<data>(GA, vs, nextBitmap, f, threshold, fl, &rec);
+    rec.keep();
+    return vs_out;
+  }
+  traversal_stats::record rec(vs.numNonzeros());
+  auto vs_out = edgeMapDataCore<data>(GA, vs, nextBitmap,
+      traversal_stats::counting_F<F>(f), threshold, fl, &rec);
+  rec.finish(should_output(fl) ? vs_out.numNonzeros() : 0);
+  return vs_out;
+}
+
 // function that reports if we are going to process a dense iter or a sparse iter 
 template <class vertex, class VS>
 bool isDenseIter(graph<vertex>& GA, VS &vs,
@@ -317,12 +364,12 @@ bool isDenseIter(graph<vertex>& GA, VS &vs,
   vs.toSparse();
   degrees = newA(uintT, m);
   frontierVertices = newA(vertex,m);
-  {parallel_for (size_t i=0; i < m; i++) {
+  {par_for(0, m, 0, [&] (size_t i) {
     uintE v_id = vs.vtx(i);
     vertex v = G[v_id];
     degrees[i] = v.getOutDegree();
     frontierVertices[i] = v;
-  }}
+  });}
 
   uintT outDegrees = sequence::plusReduce(degrees, m);
   if (outDegrees == 0) return false;
@@ -361,6 +408,10 @@ void frontierStats(VS& vs, long numVertices, bool KCore = false) {
 template <class vertex, class P>
 vertexSubsetData<uintE> packEdges(graph<vertex>& GA, vertexSubset& vs, P& p, const flags& fl=0) {
   using S = tuple<uintE, uintE>;
+  if (GA.replicated()) {
+    cout << "packEdges: replicated graphs are read-only" << endl;
+    abort();
+  }
   vs.toSparse();
   vertex* G = GA.V; long m = vs.numNonzeros(); long n = vs.numRows();
   if (vs.size() == 0) {
@@ -381,22 +432,22 @@ vertexSubsetData<uintE> packEdges(graph<vertex>& GA, vertexSubset& vs, P& p, con
   uintE* tmp1 = newA(uintE, outEdgeCount);
   uintE* tmp2 = newA(uintE, outEdgeCount);
   if (should_output(fl)) {
-    parallel_for (size_t i=0; i<m; i++) {
+    par_for(0, m, 0, [&] (size_t i) {
       uintE v = vs.vtx(i);
       size_t offset = degrees[i];
       auto bitsOff = &(bits[offset]); auto tmp1Off = &(tmp1[offset]);
       auto tmp2Off = &(tmp2[offset]);
       size_t ct = G[v].packOutNgh(v, p, bitsOff, tmp1Off, tmp2Off);
       outV[i] = make_tuple(v, ct);
-    }
+    });
   } else {
-    parallel_for (size_t i=0; i<m; i++) {
+    par_for(0, m, 0, [&] (size_t i) {
       uintE v = vs.vtx(i);
       size_t offset = degrees[i];
       auto bitsOff = &(bits[offset]); auto tmp1Off = &(tmp1[offset]);
       auto tmp2Off = &(tmp2[offset]);
       size_t ct = G[v].packOutNgh(v, p, bitsOff, tmp1Off, tmp2Off);
-    }
+    });
   }
   free(bits); free(tmp1); free(tmp2);
   if (should_output(fl)) {
@@ -422,16 +473,16 @@ vertexSubsetData<uintE> edgeMapFilter(graph<vertex>& GA, vertexSubset& vs, P& p,
     outV = newA(S, vs.size());
   }
   if (should_output(fl)) {
-    parallel_for (size_t i=0; i<m; i++) {
+    par_for(0, m, 0, [&] (size_t i) {
       uintE v = vs.vtx(i);
       size_t ct = G[v].countOutNgh(v, p);
       outV[i] = make_tuple(v, ct);
-    }
+    });
   } else {
-    parallel_for (size_t i=0; i<m; i++) {
+    par_for(0, m, 0, [&] (size_t i) {
       uintE v = vs.vtx(i);
       size_t ct = G[v].countOutNgh(v, p);
-    }
+    });
   }
   if (should_output(fl)) {
     return vertexSubsetData<uintE>(n, m, outV);
@@ -447,51 +498,54 @@ vertexSubsetData<uintE> edgeMapFilter(graph<vertex>& GA, vertexSubset& vs, P& p,
 template <class F, class VS, typename std::enable_if<
   !std::is_same<VS, vertexSubset>::value, int>::type=0 >
 void vertexMap(VS& V, F f) {
+  PERF_REGION("vertexMap");
   size_t n = V.numRows(), m = V.numNonzeros();
   if(V.dense()) {
-    parallel_for(long i=0;i<n;i++) {
+    par_for(0, n, 0, [&] (long i) {
       if(V.isIn(i)) {
         f(i, V.ithData(i));
       }
-    }
+    });
   } else {
-    parallel_for(long i=0;i<m;i++) {
+    par_for(0, m, 0, [&] (long i) {
       f(V.vtx(i), V.vtxData(i));
-    }
+    });
   }
 }
 
 template <class VS, class F, typename std::enable_if<
   std::is_same<VS, vertexSubset>::value, int>::type=0 >
 void vertexMap(VS& V, F f) {
+  PERF_REGION("vertexMap");
   size_t n = V.numRows(), m = V.numNonzeros();
   if(V.dense()) {
-    parallel_for(long i=0;i<n;i++) {
+    par_for(0, n, 0, [&] (long i) {
       if(V.isIn(i)) {
         f(i);
       }
-    }
+    });
   } else {
-    parallel_for(long i=0;i<m;i++) {
+    par_for(0, m, 0, [&] (long i) {
       f(V.vtx(i));
-    }
+    });
   }
 }
 
 template <class VS, class F, typename std::enable_if<
   std::is_same<VS, vertexSubset>::value, int>::type=0 >
 void vertexMap64(VS& V, F f) {
+  PERF_REGION("vertexMap");
   size_t n = V.numRows(), m = V.numNonzeros();
   if(V.dense()) {
-    parallel_for_64(long i=0;i<n;i++) {
+    par_for(0, n, 64, [&] (long i) {
       if(V.isIn(i)) {
         f(i);
       }
-    }
+    });
   } else {
-    parallel_for_64(long i=0;i<m;i++) {
+    par_for(0, m, 64, [&] (long i) {
       f(V.vtx(i));
-    }
+    });
   }
 }
 
@@ -499,27 +553,28 @@ void vertexMap64(VS& V, F f) {
 //input vertexSubset is returned
 template <class F>
 vertexSubset vertexFilter(vertexSubset V, F filter) {
+  PERF_REGION("vertexFilter");
   long n = V.numRows(), m = V.numNonzeros();
   V.toDense();
   bool* d_out = newA(bool,n);
-  {parallel_for(long i=0;i<n;i++) d_out[i] = 0;}
-  {parallel_for(long i=0;i<n;i++)
-      if(V.d[i]) d_out[i] = filter(i);}
+  {par_for(0, n, 0, [&] (long i) { d_out[i] = 0; });}
+  {par_for(0, n, 0, [&] (long i) { if(V.d[i]) d_out[i] = filter(i); });}
   return vertexSubset(n,d_out);
 }
 
 template <class F>
 vertexSubset vertexFilter2(vertexSubset V, F filter) {
+  PERF_REGION("vertexFilter");
   long n = V.numRows(), m = V.numNonzeros();
   if (m == 0) {
     return vertexSubset(n);
   }
   bool* bits = newA(bool, m);
   V.toSparse();
-  {parallel_for(size_t i=0; i<m; i++) {
+  {par_for(0, m, 0, [&] (size_t i) {
     uintE v = V.vtx(i);
     bits[i] = filter(v);
-  }}
+  });}
   auto v_imap = make_in_imap<uintE>(m, [&] (size_t i) { return V.vtx(i); });
   auto bits_m = make_in_imap<bool>(m, [&] (size_t i) { return bits[i]; });
   auto out = pbbs::pack(v_imap, bits_m);
@@ -530,16 +585,17 @@ vertexSubset vertexFilter2(vertexSubset V, F filter) {
 
 template <class data, class F>
 vertexSubset vertexFilter2(vertexSubsetData<data> V, F filter) {
+  PERF_REGION("vertexFilter");
   long n = V.numRows(), m = V.numNonzeros();
   if (m == 0) {
     return vertexSubset(n);
   }
   bool* bits = newA(bool, m);
   V.toSparse();
-  parallel_for(size_t i=0; i<m; i++) {
+  par_for(0, m, 0, [&] (size_t i) {
     auto t = V.vtxAndData(i);
     bits[i] = filter(std::get<0>(t), std::get<1>(t));
-  }
+  });
   auto v_imap = make_in_imap<uintE>(m, [&] (size_t i) { return V.vtx(i); });
   auto bits_m = make_in_imap<bool>(m, [&] (size_t i) { return bits[i]; });
   auto out = pbbs::pack(v_imap, bits_m);
@@ -556,6 +612,46 @@ inline bool cond_true (intT d) { return 1; }
 template<class vertex>
 void Compute(graph<vertex>&, commandLine, pvector<uintE> &new_ids);
 
+// Runs Compute once untimed and then rounds times, transposing a graph that
+// Compute left transposed after each run.
+template<class vertex>
+void runRounds(graph<vertex>& G, commandLine P, pvector<uintE> &new_ids, long rounds) {
+#ifdef MEM_STATS
+  mem_stats::report("load");
+#endif
+#ifdef ACCESS_TRACE
+  access_trace::start();
+#endif
+  for(long r=0;r<=rounds;r++) {
+#ifdef ACCESS_TRACE
+    access_trace::name_array(G.V, G.n, sizeof(vertex), "vertices");
+    if (G.n > 0) {
+#ifndef WEIGHTED
+      long words = G.m;
+#else
+      long words = 2*G.m;
+#endif
+      access_trace::name_array(G.V[0].getOutNeighbors(), words,
+                               sizeof(*G.V[0].getOutNeighbors()), "out_edges");
+    }
+#endif
+    {TRACE_SPAN("round"); Compute(G,P,new_ids);}
+    if(G.transposed) G.transpose();
+#ifdef MEM_STATS
+    mem_stats::report("round");
+#endif
+  }
+}
+
+// The input graph, or with -gen a generated one (see generators.h).
+template <class vertex>
+graph<vertex> loadGraph(commandLine P, char* iFile, bool compressed, bool symmetric, bool binary, bool mmap) {
+#ifndef WEIGHTED
+  if (P.getOptionValue("-gen")) return generators::generateGraph<vertex>(P, symmetric);
+#endif
+  return readGraph<vertex>(iFile,compressed,symmetric,binary,mmap);
+}
+
 int parallel_main(int argc, char* argv[]) {
   commandLine P(argc,argv," [-s] <inFile>");
   char* iFile = P.getArgument(0);
@@ -569,87 +665,98 @@ int parallel_main(int argc, char* argv[]) {
   int preprocess = P.getOptionIntValue("-preprocess", -1);
   //cout << "mmap = " << mmap << endl;
   long rounds = P.getOptionLongValue("-rounds",3);
+  /* NUMA placement of large arrays : interleave, partition, else - default */
+  numa::setPolicy(P.getOptionValue("-numa", ""));
+  /* thread pinning : compact, scatter, else - none; -physical uses one thread per core */
+  affinity::pin(P.getOptionValue("-pin", ""), P.getOptionValue("-physical"));
+  /* 2MB aligned, MADV_HUGEPAGE and prefaulted large arrays */
+  hugepages::enable(P.getOptionValue("-hugepages"));
+  /* read-only copy of the graph on every NUMA node */
+  bool replicate = P.getOptionValue("-replicate");
+  /* per edgeMap statistics, CSV when the name ends in .csv, else JSON Lines */
+  traversal_stats::open(P.getOptionValue("-stats", ""));
+  /* check the apps' results against serial references */
+  verify::enabled() = P.getOption("-verify");
+  verify::tolerance() = P.getOptionDoubleValue("-verify_tol", 1e-6);
+  /* read the input from disk rather than from the page cache */
+  if (P.getOptionValue("-cold_load")) dropPageCache(iFile);
+  /* timeline of graph loading, rounds and edgeMap phases in chrome trace format */
+  trace::open(P.getOptionValue("-trace", ""));
+#ifdef ACCESS_TRACE
+  /* binary trace of the rounds' memory accesses, keeping w of every p accesses */
+  access_trace::open(P.getOptionValue("-access_trace", "accesses.bin"),
+                     P.getOptionLongValue("-access_period", 1),
+                     P.getOptionLongValue("-access_window", 1));
+#endif
+#ifdef PERF_REGIONS
+  /* per region counts of the -e events, written to the -regions file */
+  perf_region_init(P.getOptionValue("-e", "cycles:u,instructions:u,LLC-load-misses:u"),
+                   P.getOptionValue("-regions", "regions.csv"));
+#endif
+#ifndef WEIGHTED
+  /* write the generated graph as <inFile>.config, .adj and .idx for -b, and stop */
+  if (P.getOptionValue("-gen") && P.getOptionValue("-gen_write")) {
+    generators::emit(P, iFile, symmetric);
+    return 0;
+  }
+#endif
   if (compressed) {
-    assert(false);
-    #if 0
+    /* a Ligra+ file written by encoder; vertex reordering and replicas need uncompressed edges */
+    if (preprocess == 0 || preprocess == 1) cout << "-preprocess ignored for a compressed graph" << endl;
+    if (replicate) cout << "-replicate ignored for a compressed graph" << endl;
     if (symmetric) {
       graph<compressedSymmetricVertex> G =
         readCompressedGraph<compressedSymmetricVertex>(iFile,symmetric,mmap); //symmetric graph
-      Compute(G,P);
-      for(int r=0;r<rounds;r++) {
-        startTime();
-        Compute(G,P);
-        nextTime("Running time");
-      }
+      pvector<uintE> new_ids(G.n, 0);
+      runRounds(G,P,new_ids,rounds);
       G.del();
     } else {
       graph<compressedAsymmetricVertex> G =
         readCompressedGraph<compressedAsymmetricVertex>(iFile,symmetric,mmap); //asymmetric graph
-      Compute(G,P);
-      if(G.transposed) G.transpose();
-      for(int r=0;r<rounds;r++) {
-        startTime();
-        Compute(G,P);
-        nextTime("Running time");
-        if(G.transposed) G.transpose();
-      }
+      pvector<uintE> new_ids(G.n, 0);
+      runRounds(G,P,new_ids,rounds);
       G.del();
     }
-    #endif
   } else {
     if (symmetric) {
       graph<symmetricVertex> G =
-        readGraph<symmetricVertex>(iFile,compressed,symmetric,binary,mmap); //symmetric graph
+        loadGraph<symmetricVertex>(P,iFile,compressed,symmetric,binary,mmap); //symmetric graph
       pvector<uintE> new_ids(G.n, 0);
       if (preprocess == 0 || preprocess == 1) {
         graph<symmetricVertex> newG = preprocessGraph<symmetricVertex>(G, symmetric, (preprocess == 0), new_ids);
         G.del();
-        Compute(newG,P,new_ids);
-        for(int r=0;r<rounds;r++) {
-          //startTime();
-          Compute(newG,P,new_ids);
-          //nextTime("Running time");
-        }
+        if (replicate) newG.replicate();
+        runRounds(newG,P,new_ids,rounds);
         newG.del();
       }
       else {
-        Compute(G,P,new_ids);
-        for(int r=0;r<rounds;r++) {
-          //startTime();
-          Compute(G,P,new_ids);
-          //nextTime("Running time");
-        }
+        if (replicate) G.replicate();
+        runRounds(G,P,new_ids,rounds);
         G.del();
       }
     } else {
       graph<asymmetricVertex> G =
-        readGraph<asymmetricVertex>(iFile,compressed,symmetric,binary,mmap); //asymmetric graph
+        loadGraph<asymmetricVertex>(P,iFile,compressed,symmetric,binary,mmap); //asymmetric graph
       pvector<uintE> new_ids(G.n, 0);
       if (preprocess == 0 || preprocess == 1) {
         graph<asymmetricVertex> newG = preprocessGraph<asymmetricVertex>(G, symmetric, (preprocess == 0), new_ids);
         G.del();
-        Compute(newG,P,new_ids);
-        if(newG.transposed) newG.transpose();
-        for(int r=0;r<rounds;r++) {
-          //startTime();
-          Compute(newG,P,new_ids);
-          if(newG.transposed) newG.transpose();
-          //nextTime("Running time");
-        }
+        if (replicate) newG.replicate();
+        runRounds(newG,P,new_ids,rounds);
         newG.del();
       }
       else {
-        Compute(G,P,new_ids);
-        if(G.transposed) G.transpose();
-        for(int r=0;r<rounds;r++) {
-          //startTime();
-          Compute(G,P,new_ids);
-          if(G.transposed) G.transpose();
-          //nextTime("Running time");
-        }
+        if (replicate) G.replicate();
+        runRounds(G,P,new_ids,rounds);
         G.del();
       }
     }
   }
+#ifdef PERF_REGIONS
+  perf_region_report();
+#endif
+#ifdef ATOMIC_STATS
+  atomic_stats::report();
+#endif
 }
 #endif
@@ -0,0 +1,258 @@
+#ifndef MEM_STATS_H
+#define MEM_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+// **************************************************************
+//    MEMORY ACCOUNTING (MEM_STATS)
+// **************************************************************
+
+// Compiled with MEM_STATS, every block returned by allocArray (newA, pvector,
+// pbbs::new_array) and allocArrayOnNode is recorded with its size, a tag and
+// the phase it was allocated in, and free() is replaced (in mem_stats.C,
+// which the Makefile links only with MEM_STATS) by a version that
+// subtracts the block before handing it to the C library. A free of a
+// block that was never recorded, as libstdc++ and OpenMP make, only reads
+// one counter and does not take the lock.
+// newA tags a block with its element type and call site, MEM_TAG(p, "name")
+// renames it. The phases are the trace::phase steps and TRACE_SPAN scopes
+// (which include the PERF_REGIONs) opened by the main thread, innermost
+// first. report() prints the current and peak bytes, the peak and the bytes
+// allocated of every phase and the live and peak bytes of every tag since
+// the previous report, then starts the next interval. Memory that does not
+// come from allocArray (mmap'ed inputs, std containers) is not counted; the
+// process high-water mark (VmHWM) is printed next to the totals for
+// comparison. Without MEM_STATS the macros are empty and free() is libc's.
+
+namespace mem_stats {
+
+  const int max_names = 256;
+  const int max_depth = 64;
+  const size_t table_size = 1 << 16;
+
+  struct block { uintptr_t p; size_t bytes; int tag, phase; };
+
+  struct tag_stats { const char* name; long allocs; size_t live, peak; };
+  struct phase_stats { const char* name; long allocs; size_t allocated, peak; bool seen; };
+
+  struct state {
+    std::mutex m;
+    size_t current, peak, intervalPeak;
+    long untracked;
+    int tags, phases, depth;
+    tag_stats tag[max_names];
+    phase_stats phase[max_names];
+    int stack[max_depth];
+    block table[table_size];
+    // live blocks whose probe sequence starts at each slot; written under
+    // the lock, read without it by untrack()
+    std::atomic<unsigned> homes[table_size];
+  };
+
+  // Zero-initialized storage, so that free() works before and after the
+  // static constructors and destructors run.
+  inline state& current() {
+    static state s;
+    return s;
+  }
+
+  // The tag newA and the other allocators hand to the next allocArray call
+  // of this thread.
+  inline const char*& next_tag() {
+    static thread_local const char* t = NULL;
+    return t;
+  }
+
+  inline size_t slot(uintptr_t p) {
+    return (size_t) ((p >> 4) * 0x9e3779b97f4a7c15ULL >> 48) & (table_size - 1);
+  }
+
+  inline int tag_index(state& s, const char* name) {
+    for (int i = 0; i < s.tags; i++)
+      if (s.tag[i].name == name || strcmp(s.tag[i].name, name) == 0) return i;
+    if (s.tags == max_names) return max_names - 1;
+    s.tag[s.tags] = tag_stats{name, 0, 0, 0};
+    return s.tags++;
+  }
+
+  inline int phase_index(state& s, const char* name) {
+    for (int i = 0; i < s.phases; i++)
+      if (s.phase[i].name == name || strcmp(s.phase[i].name, name) == 0) return i;
+    if (s.phases == max_names) return max_names - 1;
+    s.phase[s.phases] = phase_stats{name, 0, 0, 0, false};
+    return s.phases++;
+  }
+
+  // Raises the peaks of the totals, of tag t and of the open phases.
+  inline void raise(state& s, int t) {
+    s.peak = std::max(s.peak, s.current);
+    s.intervalPeak = std::max(s.intervalPeak, s.current);
+    s.tag[t].peak = std::max(s.tag[t].peak, s.tag[t].live);
+    for (int d = 0; d < s.depth && d < max_depth; d++) {
+      phase_stats& ph = s.phase[s.stack[d]];
+      ph.peak = std::max(ph.peak, s.current);
+    }
+  }
+
+  // Records a block of bytes at p under the pending tag (or def).
+  inline void track(void* p, size_t bytes, const char* def = "other") {
+    const char* name = next_tag() != NULL ? next_tag() : def;
+    next_tag() = NULL;
+    if (p == NULL) return;
+    state& s = current();
+    std::lock_guard<std::mutex> lk(s.m);
+    size_t i = slot((uintptr_t) p), probes = 0;
+    while (s.table[i].p != 0 && probes < table_size) { i = (i + 1) & (table_size - 1); probes++; }
+    if (probes == table_size) { s.untracked++; return; }
+    int t = tag_index(s, name);
+    s.homes[slot((uintptr_t) p)].fetch_add(1, std::memory_order_relaxed);
+    int ph = s.depth > 0 ? s.stack[std::min(s.depth, max_depth) - 1] : phase_index(s, "main");
+    s.table[i] = block{(uintptr_t) p, bytes, t, ph};
+    s.current += bytes;
+    s.tag[t].live += bytes; s.tag[t].allocs++;
+    s.phase[ph].allocated += bytes; s.phase[ph].allocs++; s.phase[ph].seen = true;
+    s.phase[ph].peak = std::max(s.phase[ph].peak, s.current);
+    raise(s, t);
+  }
+
+  inline size_t find(state& s, void* p) {
+    size_t i = slot((uintptr_t) p);
+    for (size_t probes = 0; probes < table_size; probes++) {
+      if (s.table[i].p == (uintptr_t) p) return i;
+      if (s.table[i].p == 0) return table_size;
+      i = (i + 1) & (table_size - 1);
+    }
+    return table_size;
+  }
+
+  // Forgets the block at p, if it is one; called by free(). A recorded
+  // block is live until this call, so its home count cannot drop to 0
+  // meanwhile, and a count of 0 means p was never recorded.
+  inline void untrack(void* p) {
+    state& s = current();
+    if (s.homes[slot((uintptr_t) p)].load(std::memory_order_relaxed) == 0) return;
+    std::lock_guard<std::mutex> lk(s.m);
+    size_t i = find(s, p);
+    if (i == table_size) return;
+    block b = s.table[i];
+    s.homes[slot((uintptr_t) p)].fetch_sub(1, std::memory_order_relaxed);
+    s.current -= b.bytes;
+    s.tag[b.tag].live -= b.bytes;
+    // backward shift deletion keeps the probe sequences unbroken
+    size_t j = i;
+    for (;;) {
+      s.table[i].p = 0;
+      for (;;) {
+        j = (j + 1) & (table_size - 1);
+        if (s.table[j].p == 0) return;
+        size_t k = slot(s.table[j].p);
+        if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j)) continue;
+        break;
+      }
+      s.table[i] = s.table[j];
+      i = j;
+    }
+  }
+
+  // Moves the block at p to the tag name. The old tag keeps its peak, but
+  // a tag without allocations or live bytes is not reported.
+  inline void name_block(void* p, const char* name) {
+    state& s = current();
+    std::lock_guard<std::mutex> lk(s.m);
+    size_t i = find(s, p);
+    if (i == table_size) return;
+    block& b = s.table[i];
+    s.tag[b.tag].live -= b.bytes; s.tag[b.tag].allocs--;
+    b.tag = tag_index(s, name);
+    s.tag[b.tag].live += b.bytes; s.tag[b.tag].allocs++;
+    raise(s, b.tag);
+  }
+
+  // Phases are only opened and closed by the main thread.
+  inline bool main_thread() {
+    static thread_local bool m = (getpid() == (pid_t) syscall(SYS_gettid));
+    return m;
+  }
+
+  inline void push(const char* name) {
+    if (!main_thread()) return;
+    state& s = current();
+    std::lock_guard<std::mutex> lk(s.m);
+    if (s.depth < max_depth) {
+      int ph = phase_index(s, name);
+      s.phase[ph].seen = true;
+      s.phase[ph].peak = std::max(s.phase[ph].peak, s.current);
+      s.stack[s.depth] = ph;
+    }
+    s.depth++;
+  }
+
+  inline void pop() {
+    if (!main_thread()) return;
+    state& s = current();
+    std::lock_guard<std::mutex> lk(s.m);
+    if (s.depth > 0) s.depth--;
+  }
+
+  inline double mb(size_t bytes) { return bytes / 1048576.0; }
+
+  // Peak resident set size of the process in kB, from /proc/self/status.
+  inline long vm_hwm() {
+    FILE* f = fopen("/proc/self/status", "r");
+    if (f == NULL) return -1;
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), f) != NULL)
+      if (sscanf(line, "VmHWM: %ld kB", &kb) == 1) break;
+    fclose(f);
+    return kb;
+  }
+
+  // Prints the interval since the previous report and starts a new one.
+  inline void report(const char* label) {
+    long hwm = vm_hwm();  // fclose frees, so not under the lock
+    state& s = current();
+    std::lock_guard<std::mutex> lk(s.m);
+    printf("memory after %s: current %.1f MB, peak %.1f MB (overall %.1f MB, VmHWM %.1f MB)\n",
+           label, mb(s.current), mb(s.intervalPeak), mb(s.peak), hwm / 1024.0);
+    printf("  %-34s %8s %12s %12s\n", "phase", "allocs", "alloc MB", "peak MB");
+    for (int i = 0; i < s.phases; i++) {
+      phase_stats& ph = s.phase[i];
+      if (!ph.seen) continue;
+      printf("  %-34s %8ld %12.1f %12.1f\n", ph.name, ph.allocs, mb(ph.allocated), mb(ph.peak));
+      ph.allocs = 0; ph.allocated = 0; ph.peak = s.current; ph.seen = false;
+    }
+    printf("  %-34s %8s %12s %12s\n", "tag", "allocs", "live MB", "peak MB");
+    for (int i = 0; i < s.tags; i++) {
+      tag_stats& t = s.tag[i];
+      if (t.allocs == 0 && t.live == 0) continue;
+      printf("  %-34s %8ld %12.1f %12.1f\n", t.name, t.allocs, mb(t.live), mb(t.peak));
+      t.allocs = 0; t.peak = t.live;
+    }
+    if (s.untracked > 0)
+      printf("  %ld blocks were not tracked (table full)\n", s.untracked);
+    s.intervalPeak = s.current;
+  }
+}
+
+#define MEM_STATS_STR2(x) #x
+#define MEM_STATS_STR(x) MEM_STATS_STR2(x)
+
+#ifdef MEM_STATS
+#define MEM_TAG(p, name) mem_stats::name_block((p), (name))
+#define MEM_NEXT_TAG(name) (mem_stats::next_tag() = (name))
+#define MEM_SITE(type) type " " __FILE__ ":" MEM_STATS_STR(__LINE__)
+#else
+#define MEM_TAG(p, name)
+#define MEM_NEXT_TAG(name)
+#endif
+
+#endif
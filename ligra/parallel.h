@@ -71,6 +71,28 @@ static void setWorkers(int n) {
   }
 }
 
+// work-stealing scheduler of scheduler.h, the only pool of threads in this
+// build (it does not link OpenMP). A statement cannot be handed to a
+// library scheduler, so HOMEGROWN builds cannot use the statement forms
+// parallel_for, parallel_for_1/64/256, cilk_for, cilk_spawn and cilk_sync:
+// each expands to a static_assert saying so, and code using them has to
+// be written with par_for and par_do below (granular_for in utils.h is
+// built on par_for and works in every build).
+#elif defined(HOMEGROWN)
+#include "scheduler.h"
+#define LIGRA_HOMEGROWN_NO_STATEMENT_FORMS \
+  static_assert(false, "HOMEGROWN builds cannot use parallel_for or cilk_spawn; use par_for or par_do");
+#define parallel_for LIGRA_HOMEGROWN_NO_STATEMENT_FORMS for
+#define parallel_for_1 LIGRA_HOMEGROWN_NO_STATEMENT_FORMS for
+#define parallel_for_256 LIGRA_HOMEGROWN_NO_STATEMENT_FORMS for
+#define parallel_for_64 LIGRA_HOMEGROWN_NO_STATEMENT_FORMS for
+#define cilk_for LIGRA_HOMEGROWN_NO_STATEMENT_FORMS for
+#define cilk_spawn LIGRA_HOMEGROWN_NO_STATEMENT_FORMS
+#define cilk_sync LIGRA_HOMEGROWN_NO_STATEMENT_FORMS
+#define parallel_main main
+static int getWorkers() { return ligra_ws::num_workers(); }
+static void setWorkers(int n) { ligra_ws::set_num_workers(n); }
+
 // openmp
 #elif defined(OPENMP)
 #include <omp.h>
@@ -99,6 +121,59 @@ static void setWorkers(int n) { }
 
 #endif
 
+// Function forms of the loops above, for code that needs nested
+// parallelism. par_for(start, end, grain, f) calls f(i) for every i in
+// [start, end), handing out about grain iterations at a time (0 lets the
+// runtime choose). par_do(left, right) runs the two closures in parallel.
+// Under OPENMP, calls made inside a parallel region run serially, as nested
+// OpenMP regions do, also when the region has a single thread; under
+// HOMEGROWN they are balanced by work stealing.
+#if defined(HOMEGROWN)
+template <class F>
+inline void par_for(long start, long end, long grain, F f) {
+  ligra_ws::parfor(start, end, f, grain);
+}
+template <class L, class R>
+inline void par_do(L left, R right) { ligra_ws::par_do(left, right); }
+
+#elif defined(CILK) || defined(CILKP)
+template <class F>
+inline void par_for(long start, long end, long grain, F f) {
+  cilk_for (long i=start; i<end; i++) f(i);
+}
+template <class L, class R>
+inline void par_do(L left, R right) {
+  cilk_spawn left();
+  right();
+  cilk_sync;
+}
+
+#elif defined(OPENMP)
+template <class F>
+inline void par_for(long start, long end, long grain, F f) {
+  // omp_in_parallel() is false in a team of one thread; the level is not
+  if (omp_get_level() > 0) {
+    for (long i=start; i<end; i++) f(i);
+  } else if (grain > 0) {
+    #pragma omp parallel for schedule (dynamic, grain)
+    for (long i=start; i<end; i++) f(i);
+  } else {
+    #pragma omp parallel for
+    for (long i=start; i<end; i++) f(i);
+  }
+}
+template <class L, class R>
+inline void par_do(L left, R right) { left(); right(); }
+
+#else
+template <class F>
+inline void par_for(long start, long end, long grain, F f) {
+  for (long i=start; i<end; i++) f(i);
+}
+template <class L, class R>
+inline void par_do(L left, R right) { left(); right(); }
+#endif
+
 #include <limits.h>
 
 #if defined(LONG)
@@ -5,6 +5,10 @@
 #define PVECTOR_H_
 
 #include <algorithm>
+#include <new>
+#include <type_traits>
+
+#include "allocator.h"
 
 
 /*
@@ -16,6 +20,7 @@ Vector class with ability to not initialize or do initialize in parallel
  - std::vector (when resizing) will always initialize, and does it serially
  - When pvector is resized, new elements are uninitialized
  - Resizing is not thread-safe
+ - Storage comes from allocArray, so large vectors follow the NUMA policy
 */
 
 
@@ -27,7 +32,7 @@ class pvector {
   pvector() : start_(nullptr), end_size_(nullptr), end_capacity_(nullptr) {}
 
   explicit pvector(size_t num_elements) {
-    start_ = new T_[num_elements];
+    start_ = allocate(num_elements);
     end_size_ = start_ + num_elements;
     end_capacity_ = end_size_;
   }
@@ -38,9 +43,9 @@ class pvector {
 
   pvector(iterator copy_begin, iterator copy_end)
       : pvector(copy_end - copy_begin) {
-    #pragma omp parallel for
-    for (size_t i=0; i < capacity(); i++)
+    par_for(0, capacity(), 0, [&] (size_t i) {
       start_[i] = copy_begin[i];
+    });
   }
 
   // don't want this to be copied, too much data to move
@@ -67,19 +72,18 @@ class pvector {
   }
 
   ~pvector() {
-    if (start_ != nullptr)
-      delete[] start_;
+    release(start_, capacity());
   }
 
   // not thread-safe
   void reserve(size_t num_elements) {
     if (num_elements > capacity()) {
-      T_ *new_range = new T_[num_elements];
-      #pragma omp parallel for
-      for (size_t i=0; i < size(); i++)
+      T_ *new_range = allocate(num_elements);
+      par_for(0, size(), 0, [&] (size_t i) {
         new_range[i] = start_[i];
+      });
       end_size_ = new_range + size();
-      delete[] start_;
+      release(start_, capacity());
       start_ = new_range;
       end_capacity_ = start_ + num_elements;
     }
@@ -116,9 +120,9 @@ class pvector {
   }
 
   void fill(T_ init_val) {
-    #pragma omp parallel for
-    for (T_* ptr=start_; ptr < end_size_; ptr++)
-      *ptr = init_val;
+    par_for(0, size(), 0, [&] (size_t i) {
+      start_[i] = init_val;
+    });
   }
 
   size_t capacity() const {
@@ -149,6 +153,29 @@ class pvector {
 
 
  private:
+  // Default-constructs in parallel; trivial types are left uninitialized,
+  // as with new T_[].
+  static T_* allocate(size_t num_elements) {
+    MEM_NEXT_TAG("pvector");
+    T_* r = static_cast<T_*>(allocArray(num_elements * sizeof(T_)));
+    if (!std::is_trivially_default_constructible<T_>::value) {
+      par_for(0, num_elements, 0, [&] (size_t i) {
+        new (static_cast<void*>(r + i)) T_();
+      });
+    }
+    return r;
+  }
+
+  static void release(T_* range, size_t num_elements) {
+    if (range == nullptr)
+      return;
+    if (!std::is_trivially_destructible<T_>::value) {
+      for (size_t i=0; i < num_elements; i++)
+        range[i].~T_();
+    }
+    free(range);
+  }
+
   T_* start_;
   T_* end_size_;
   T_* end_capacity_;
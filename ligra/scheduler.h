@@ -0,0 +1,291 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// **************************************************************
+//    WORK-STEALING FORK-JOIN SCHEDULER (HOMEGROWN)
+// **************************************************************
+
+// Every worker owns a deque of jobs (Arora, Blumofe and Plaxton). par_do
+// pushes its right branch on the bottom of the caller's deque and runs the
+// left branch itself; idle workers steal from the top of random victims.
+// parfor splits its range in halves down to the grain, so a loop nested in
+// a parallel loop is spread over the idle workers as well.
+//
+// The workers start on first use, from the main thread, which becomes
+// worker 0; a run that never forks starts no threads. Other threads run
+// par_do and parfor serially. The number of workers is OMP_NUM_THREADS
+// when set, else the number of hardware threads. Idle workers sleep on a
+// condition variable until a spawn wakes them.
+
+namespace ligra_ws {
+
+  struct job {
+    std::atomic<bool> done;
+    job() : done(false) {}
+    virtual void execute() = 0;
+    void run() {
+      execute();
+      done.store(true, std::memory_order_release);
+    }
+  };
+
+  template <class F>
+  struct lambda_job : public job {
+    F& f;
+    lambda_job(F& _f) : f(_f) {}
+    void execute() { f(); }
+  };
+
+  // The owner pushes and pops at the bottom, thieves pop at the top. The tag
+  // in age avoids ABA when the owner resets an emptied deque.
+  struct deque {
+    // deepest nesting of par_do calls on one worker; deeper calls run
+    // serially
+    static const unsigned q_size = 1000;
+    struct age_t { unsigned tag; unsigned top; };
+    struct alignas(64) entry { std::atomic<job*> j; };
+
+    alignas(64) std::atomic<unsigned> bot;
+    alignas(64) std::atomic<age_t> age;
+    entry deq[q_size];
+
+    deque() : bot(0), age(age_t{0, 0}) {
+      for (unsigned i = 0; i < q_size; i++) deq[i].j.store(NULL);
+    }
+
+    bool empty() { return bot.load() <= age.load().top; }
+
+    // owner only
+    bool full() { return bot.load(std::memory_order_relaxed) >= q_size; }
+
+    // The job is stored before bot publishes it: a thief that sees the new
+    // bot (seq_cst, so also ordered against its load of age) reads the job.
+    void push_bottom(job* j) {
+      unsigned b = bot.load(std::memory_order_relaxed);
+      deq[b].j.store(j, std::memory_order_release);
+      bot.store(b + 1, std::memory_order_seq_cst);
+    }
+
+    job* pop_top() {
+      age_t old_age = age.load();
+      unsigned b = bot.load();
+      if (b > old_age.top) {
+        job* j = deq[old_age.top].j.load(std::memory_order_acquire);
+        age_t new_age = old_age;
+        new_age.top++;
+        if (age.compare_exchange_strong(old_age, new_age)) return j;
+      }
+      return NULL;
+    }
+
+    job* pop_bottom() {
+      unsigned b = bot.load(std::memory_order_relaxed);
+      if (b == 0) return NULL;
+      b--;
+      bot.store(b, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      job* j = deq[b].j.load(std::memory_order_relaxed);
+      age_t old_age = age.load(std::memory_order_relaxed);
+      if (b > old_age.top) return j;
+      // last job: race the thieves for it, then reset the deque
+      bot.store(0, std::memory_order_relaxed);
+      age_t new_age{old_age.tag + 1, 0};
+      job* r = NULL;
+      if (b == old_age.top && age.compare_exchange_strong(old_age, new_age)) r = j;
+      else age.store(new_age, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      return r;
+    }
+  };
+
+  inline int& worker_id() {
+    static thread_local int id = -1;
+    return id;
+  }
+
+  // Called on every worker, with its id, when the workers start; used to
+  // pin them (see affinity.h).
+  inline void (*&on_worker_start())(int) {
+    static void (*f)(int) = NULL;
+    return f;
+  }
+
+  class scheduler {
+  public:
+    int num_workers;
+    deque* deques;
+    std::vector<std::thread> threads;
+    std::vector<long> tids;  // kernel thread id of every worker
+    std::atomic<bool> finished;
+    std::atomic<int> sleepers;
+    std::mutex m;
+    std::condition_variable cv;
+
+    scheduler(int p) : num_workers(p), tids(p, 0), finished(false), sleepers(0) {
+      deques = new deque[p];
+      worker_id() = 0;
+      tids[0] = syscall(SYS_gettid);
+      if (on_worker_start() != NULL) on_worker_start()(0);
+      for (int i = 1; i < p; i++)
+        threads.emplace_back([this, i] {
+          worker_id() = i;
+          tids[i] = syscall(SYS_gettid);
+          if (on_worker_start() != NULL) on_worker_start()(i);
+          worker_loop();
+        });
+    }
+
+    ~scheduler() {
+      finished.store(true);
+      { std::lock_guard<std::mutex> lk(m); cv.notify_all(); }
+      for (std::thread& t : threads) t.join();
+      worker_id() = -1;
+      delete[] deques;
+    }
+
+    void spawn(job* j) {
+      deques[worker_id()].push_bottom(j);
+      if (sleepers.load() > 0) {
+        std::lock_guard<std::mutex> lk(m);
+        cv.notify_one();
+      }
+    }
+
+    job* steal(int id) {
+      static thread_local unsigned seed = 0x9e3779b9u * (id + 1);
+      for (int k = 0; k < num_workers; k++) {
+        seed = seed * 1103515245u + 12345u;
+        int victim = (seed >> 8) % num_workers;
+        if (victim == id) continue;
+        job* j = deques[victim].pop_top();
+        if (j != NULL) return j;
+      }
+      return NULL;
+    }
+
+    bool has_work() {
+      for (int i = 0; i < num_workers; i++)
+        if (!deques[i].empty()) return true;
+      return false;
+    }
+
+    // Runs stolen jobs until j, whose owner lost it to a thief, is done.
+    void wait_for(job& j) {
+      int id = worker_id();
+      while (!j.done.load(std::memory_order_acquire)) {
+        job* k = steal(id);
+        if (k != NULL) k->run();
+        else std::this_thread::yield();
+      }
+    }
+
+    // Idle workers spin on steals for a while, then sleep until a spawn
+    // finds them sleeping. A spawn pushes its job before it reads sleepers
+    // and a worker counts itself before it looks for work under m, so
+    // either the spawn notifies or the worker sees the job.
+    void worker_loop() {
+      int id = worker_id();
+      int fails = 0;
+      while (!finished.load(std::memory_order_relaxed)) {
+        job* j = deques[id].pop_bottom();
+        if (j == NULL) j = steal(id);
+        if (j != NULL) { j->run(); fails = 0; continue; }
+        if (++fails < 2000) { std::this_thread::yield(); continue; }
+        sleepers.fetch_add(1);
+        {
+          std::unique_lock<std::mutex> lk(m);
+          cv.wait(lk, [this] { return finished.load() || has_work(); });
+        }
+        sleepers.fetch_sub(1);
+        fails = 0;
+      }
+    }
+  };
+
+  inline int default_workers() {
+    const char* s = getenv("OMP_NUM_THREADS");
+    int p = (s != NULL) ? atoi(s) : 0;
+    if (p <= 0) p = std::thread::hardware_concurrency();
+    return (p <= 0) ? 1 : p;
+  }
+
+  inline scheduler*& instance() {
+    static scheduler* s = NULL;
+    return s;
+  }
+
+  inline scheduler* get_scheduler() {
+    static std::mutex init;
+    scheduler*& s = instance();
+    if (s == NULL) {
+      std::lock_guard<std::mutex> lk(init);
+      if (s == NULL) s = new scheduler(default_workers());
+    }
+    return s;
+  }
+
+  inline int num_workers() { return get_scheduler()->num_workers; }
+
+  // Kernel thread ids of the workers; 0 for a worker that has not started.
+  inline std::vector<long> worker_tids() { return get_scheduler()->tids; }
+
+  // Replaces the workers; call outside of parallel code. restart replaces
+  // them even when the count does not change, so on_worker_start runs again.
+  inline void set_num_workers(int p, bool restart = false) {
+    scheduler*& s = instance();
+    if (s != NULL && s->num_workers == p && !restart) return;
+    delete s;
+    s = new scheduler(p < 1 ? 1 : p);
+  }
+
+  template <class L, class R>
+  inline void par_do(L left, R right) {
+    scheduler* s = get_scheduler();
+    int id = worker_id();
+    if (id < 0 || s->num_workers == 1 || s->deques[id].full()) {
+      left(); right();
+      return;
+    }
+    lambda_job<R> rj(right);
+    s->spawn(&rj);
+    left();
+    // left() joined everything it spawned, so the bottom job is rj unless
+    // a thief took it
+    if (s->deques[id].pop_bottom() != NULL) right();
+    else s->wait_for(rj);
+  }
+
+  template <class F>
+  inline void parfor_rec(long start, long end, F& f, long grain) {
+    if (end - start <= grain) {
+      for (long i = start; i < end; i++) f(i);
+    } else {
+      long mid = start + (end - start) / 2;
+      par_do([&] { parfor_rec(start, mid, f, grain); },
+             [&] { parfor_rec(mid, end, f, grain); });
+    }
+  }
+
+  // Calls f(i) for i in [start, end). A grain of 0 picks about eight
+  // chunks per worker.
+  template <class F>
+  inline void parfor(long start, long end, F f, long grain = 0) {
+    if (end <= start) return;
+    if (grain <= 0) {
+      grain = (end - start) / (8 * (long) get_scheduler()->num_workers);
+      if (grain < 1) grain = 1;
+    }
+    parfor_rec(start, end, f, grain);
+  }
+}
+
+#endif
@@ -39,11 +39,11 @@ namespace pbbs {
   template <class F>
   void sliced_for(size_t n, size_t block_size, const F& f) {
     size_t l = num_blocks(n, block_size);
-    parallel_for_1 (size_t i = 0; i < l; i++) {
+    par_for (0, l, 1, [&] (size_t i) {
       size_t s = i * block_size;
       size_t e = min(s + block_size, n);
       f(i, s, e);
-    }
+    });
   }
 
   template <class Index_Map, class F>
@@ -265,24 +265,24 @@ namespace pbbs {
      size_t l = nblocks(n, b);
      b = nblocks(n, l);
      size_t *Sums = new_array_no_init<size_t>(l + 1);
-     parallel_for_1 (size_t i = 0; i < l; i++) {
+     par_for(0, l, 1, [&] (size_t i) {
        size_t s = i * b;
        size_t e = min(s + b, n);
        size_t k = s;
        for (size_t j = s; j < e; j++)
    	if (p(In[j])) In[k++] = In[j];
        Sums[i] = k - s;
-     }
+     });
      auto isums = array_imap<size_t>(Sums,l);
      size_t m = scan_add(isums, isums);
      Sums[l] = m;
-     parallel_for_1 (size_t i = 0; i < l; i++) {
+     par_for(0, l, 1, [&] (size_t i) {
        T* I = In + i*b;
        T* O = Out + Sums[i];
        for (size_t j = 0; j < Sums[i+1]-Sums[i]; j++) {
         O[j] = I[j];
        }
-     }
+     });
      free(Sums);
      return m;
    }
@@ -294,7 +294,7 @@ namespace pbbs {
        return filter_serial(In, Out, n, p);
      size_t l = nblocks(n, b);
      b = nblocks(n, l);
-     parallel_for_1 (size_t i = 0; i < l; i++) {
+     par_for(0, l, 1, [&] (size_t i) {
        size_t s = i * b;
        size_t e = min(s + b, n);
        size_t k = s;
@@ -308,18 +308,18 @@ namespace pbbs {
         }
        }
        Sums[i] = k - s;
-     }
+     });
      auto isums = array_imap<size_t>(Sums,l);
      size_t m = scan_add(isums, isums);
      Sums[l] = m;
-     parallel_for_1 (size_t i = 0; i < l; i++) {
+     par_for(0, l, 1, [&] (size_t i) {
        T* I = In + i*b;
        T* O = Out + Sums[i];
        for (size_t j = 0; j < Sums[i+1]-Sums[i]; j++) {
         O[j] = I[j];
         I[j] = empty;
        }
-     }
+     });
      return m;
    }
 
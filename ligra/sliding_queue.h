@@ -7,6 +7,7 @@
 #include <algorithm>
 
 #include "platform_atomics.h"
+#include "allocator.h"
 
 
 /*
@@ -33,12 +34,12 @@ class SlidingQueue {
 
  public:
   explicit SlidingQueue(size_t shared_size) {
-    shared = new T[shared_size];
+    shared = (T*) allocArray(shared_size * sizeof(T));
     reset();
   }
 
   ~SlidingQueue() {
-    delete[] shared;
+    free(shared);
   }
 
   void push_back(T to_add) {
@@ -0,0 +1,304 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "parallel.h"
+#include "affinity.h"
+#include "trace.h"
+#include "maybe.h"
+
+// **************************************************************
+//    PER-ITERATION TRAVERSAL STATISTICS
+// **************************************************************
+
+// A round is one timed run of an app's main loop (start_counter begins a
+// new one) and an iteration is one edgeMapData call within it; iteration 0
+// is the work before the first edgeMap of a round.
+//
+// With -stats <file> every edgeMapData call writes one record to file, as
+// CSV when the name ends in .csv and as JSON Lines otherwise:
+//
+//   round, iteration
+//   frontier     vertices in the input frontier
+//   out_degrees  sum of their out-degrees
+//   mode         sparse, dense, dense_forward or empty
+//   edges        edges on which update or updateAtomic ran
+//   updates      calls that returned true, i.e. activated their target
+//   output       vertices in the output frontier (0 with no_output)
+//   ns           time spent in edgeMapData
+//   busy_ns, chunks, loop_edges
+//                per worker: time spent in, chunks of and edges handed to
+//                the traversal loop (lists, ';' separated in CSV)
+//   imbalance    max/mean of busy_ns over all workers (1 is perfect)
+//
+// edges and updates are counted by wrapping the update functor, so without
+// -stats edgeMapData only tests enabled(). Functors that mark the next
+// frontier themselves (updateAtomic of BFS_F, Radii_F and BC_F) return
+// whether they did, so updates counts their activations too.
+
+namespace traversal_stats {
+
+  struct position { long round, iteration; };
+
+  inline position& current() {
+    static position p = {0, 0};
+    return p;
+  }
+
+  inline void next_round() { current().round++; current().iteration = 0; }
+  inline void next_iteration() { current().iteration++; }
+
+  // Sum of the out-degrees of all edgeMap frontiers, kept whatever the
+  // options (one add per edgeMap); the edges a push traversal examines.
+  inline long& examined() {
+    static long e = 0;
+    return e;
+  }
+
+  struct output {
+    FILE* f;
+    bool csv;
+  };
+
+  inline output& out() {
+    static output o = {NULL, false};
+    return o;
+  }
+
+  inline bool enabled() { return out().f != NULL; }
+
+  // An edgeMapData call as the benchmark harness keeps it in memory
+  // (-ceilings), without the per-edge counting of -stats.
+  struct iteration {
+    long frontier, outDegrees;
+    const char* mode;
+    long ns;
+  };
+
+  // Where edgeMapData appends its iterations; NULL (the default) keeps none.
+  inline std::vector<iteration>*& collector() {
+    static std::vector<iteration>* c = NULL;
+    return c;
+  }
+
+  // Opens the statistics file; an empty name leaves statistics off.
+  inline void open(const std::string& filename) {
+    if (filename == "") return;
+    output& o = out();
+    o.f = fopen(filename.c_str(), "w");
+    if (o.f == NULL) { perror(filename.c_str()); return; }
+    o.csv = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".csv") == 0;
+    if (o.csv)
+      fprintf(o.f, "round,iteration,frontier,out_degrees,mode,edges,updates,output,ns,"
+              "busy_ns,chunks,loop_edges,imbalance\n");
+  }
+
+  // Per thread counts of update calls, padded to a cache line each; the
+  // threads register their counters on first use.
+  struct alignas(64) counter { long edges, updates; };
+
+  inline std::vector<counter*>& counters() {
+    static std::vector<counter*> c;
+    return c;
+  }
+
+  inline counter& local() {
+    static thread_local counter* mine = NULL;
+    if (mine == NULL) {
+      static std::mutex m;
+      std::lock_guard<std::mutex> lk(m);
+      mine = new counter();
+      counters().push_back(mine);
+    }
+    return *mine;
+  }
+
+  // Sums the counters; call outside of parallel code.
+  inline void totals(long& edges, long& updates) {
+    edges = updates = 0;
+    for (counter* c : counters()) { edges += c->edges; updates += c->updates; }
+  }
+
+  inline bool succeeded(bool b) { return b; }
+  template <class T>
+  inline bool succeeded(const Maybe<T>& m) { return m.exists; }
+
+  // Passes update, updateAtomic and cond through to f, counting the updates.
+  template <class F>
+  struct counting_F {
+    F& f;
+    counting_F(F& _f) : f(_f) {}
+    template <class... A>
+    inline auto update(A... a) {
+      auto r = f.update(a...);
+      counter& c = local();
+      c.edges++; c.updates += succeeded(r);
+      return r;
+    }
+    template <class... A>
+    inline auto updateAtomic(A... a) {
+      auto r = f.updateAtomic(a...);
+      counter& c = local();
+      c.edges++; c.updates += succeeded(r);
+      return r;
+    }
+    template <class D>
+    inline bool cond(D d) { return f.cond(d); }
+  };
+
+  // Per worker load of the traversal loops, indexed by worker number.
+  struct alignas(64) worker_load {
+    std::atomic<long> ns, chunks, edges;
+  };
+
+  const int max_workers = 256;
+
+  inline worker_load* loads() {
+    static worker_load l[max_workers];
+    return l;
+  }
+
+  inline void reset_loads() {
+    for (int w = 0; w < max_workers; w++) {
+      loads()[w].ns.store(0); loads()[w].chunks.store(0); loads()[w].edges.store(0);
+    }
+  }
+
+  inline int worker_index() {
+#if defined(HOMEGROWN)
+    if (ligra_ws::worker_id() >= 0) return ligra_ws::worker_id() % max_workers;
+#endif
+#if defined(_OPENMP)
+    return omp_get_thread_num() % max_workers;
+#elif defined(CILK) || defined(CILKP)
+    return __cilkrts_get_worker_number() % max_workers;
+#else
+    return 0;
+#endif
+  }
+
+  // An edgeMap traversal loop: f(i) for i in [0, n) in chunks of grain,
+  // run by par(count, g, span, body), which calls body(c) for c in
+  // [0, count) where c stands for the span indices starting at c*span. While statistics are on, every chunk is timed
+  // and its time and edges (the sum of weight(i)) are added to the load of
+  // the worker that ran it. While tracing, each worker's back to back
+  // chunks form one "edgeMap/traverse" span.
+  template <class F, class W, class R>
+  inline void timed_loop(long n, long grain, F f, W weight, R par) {
+    bool on = enabled(), tracing = trace::enabled();
+    if (!on && !tracing) {
+      par(n, grain, 1, f);
+      return;
+    }
+    long chunks = (n + grain - 1) / grain;
+    auto chunk = [&] (long c) {
+      int64_t t1 = trace::now();
+      long e = 0;
+      for (long i = c * grain; i < std::min(n, (c + 1) * grain); i++) {
+        f(i);
+        if (on) e += weight(i);
+      }
+      int64_t t2 = trace::now();
+      if (tracing) trace::extend("edgeMap/traverse", t1, t2);
+      if (!on) return;
+      worker_load& l = loads()[worker_index()];
+      l.ns.fetch_add(t2 - t1, std::memory_order_relaxed);
+      l.chunks.fetch_add(1, std::memory_order_relaxed);
+      l.edges.fetch_add(e, std::memory_order_relaxed);
+    };
+    par(chunks, 1, grain, chunk);
+  }
+
+  // timed_loop through par_for, for loops over frontier indices.
+  template <class F, class W>
+  inline void loop_for(long n, long grain, F f, W weight) {
+    timed_loop(n, grain, f, weight, [&] (long count, long g, long, auto body) {
+      par_for(0, count, g, body);
+    });
+  }
+
+  // timed_loop over the vertices [0, n) through node_par_for, with the
+  // range of each node cut where its part of the edge array starts; pos(v)
+  // is the address of v's edges (see affinity::edgeCut). A chunk goes with
+  // the range its first vertex falls in.
+  template <class F, class W, class P>
+  inline void node_loop_for(long n, long grain, F f, W weight, P pos) {
+    timed_loop(n, grain, f, weight, [&] (long count, long g, long span, auto body) {
+      affinity::node_par_for_cut(count, g, body, [&] (int s, int k) {
+        return (affinity::edgeCut(n, s, k, pos) + span - 1) / span;
+      });
+    });
+  }
+
+  // One edgeMapData call. edgeMapData fills in out_degrees and mode,
+  // finish() writes the record.
+  struct record {
+    position pos;
+    long frontier, outDegrees;
+    const char* mode;
+    long edges0, updates0;
+    std::chrono::high_resolution_clock::time_point startTime;
+
+    record(long _frontier) : pos(current()), frontier(_frontier), outDegrees(0), mode("empty") {
+      totals(edges0, updates0);
+      reset_loads();
+      startTime = std::chrono::high_resolution_clock::now();
+    }
+
+    // Writes the per worker loads as a list and returns max/mean busy time.
+    double write_loads(FILE* f, bool csv) {
+      int p = std::max(1, std::min(getWorkers(), max_workers));
+      long mx = 0, sum = 0;
+      const char* sep = csv ? ";" : ",";
+      const char* open = csv ? "" : "[";
+      const char* close = csv ? "" : "]";
+      const char* names[] = {"busy_ns", "chunks", "loop_edges"};
+      for (int k = 0; k < 3; k++) {
+        fprintf(f, csv ? "," : ",\"%s\":", names[k]);
+        fprintf(f, "%s", open);
+        for (int w = 0; w < p; w++) {
+          worker_load& l = loads()[w];
+          long v = (k == 0) ? l.ns.load() : (k == 1) ? l.chunks.load() : l.edges.load();
+          fprintf(f, "%s%ld", w ? sep : "", v);
+          if (k == 0) { mx = std::max(mx, v); sum += v; }
+        }
+        fprintf(f, "%s", close);
+      }
+      return sum > 0 ? (double) mx * p / sum : 0;
+    }
+
+    // Appends the call to the collector, if any; returns its time in ns.
+    long keep() {
+      auto t2 = std::chrono::high_resolution_clock::now();
+      long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - startTime).count();
+      if (collector() != NULL) collector()->push_back(iteration{frontier, outDegrees, mode, ns});
+      return ns;
+    }
+
+    void finish(long outputSize) {
+      long ns = keep();
+      long edges, updates;
+      totals(edges, updates);
+      edges -= edges0; updates -= updates0;
+      output& o = out();
+      if (o.csv)
+        fprintf(o.f, "%ld,%ld,%ld,%ld,%s,%ld,%ld,%ld,%ld", pos.round, pos.iteration,
+                frontier, outDegrees, mode, edges, updates, outputSize, ns);
+      else
+        fprintf(o.f, "{\"round\":%ld,\"iteration\":%ld,\"frontier\":%ld,\"out_degrees\":%ld,"
+                "\"mode\":\"%s\",\"edges\":%ld,\"updates\":%ld,\"output\":%ld,\"ns\":%ld",
+                pos.round, pos.iteration, frontier, outDegrees, mode, edges, updates,
+                outputSize, ns);
+      double imbalance = write_loads(o.f, o.csv);
+      fprintf(o.f, o.csv ? ",%.3f\n" : ",\"imbalance\":%.3f}\n", imbalance);
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,302 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <iostream>
+#include <fstream>
+#include <stdlib.h>
+#include <cmath>
+#include "parallel.h"
+#include "utils.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__SSSE3__) && !defined(EDGELONG)
+#include <tmmintrin.h>
+#define STREAMVBYTE_SIMD
+#endif
+
+typedef unsigned char uchar;
+
+/*
+  Group varint codes in the Stream VByte layout. The edge list of a
+  vertex of degree d is d 32-bit values: the first edge as target-source
+  (zigzag coded, so that the sign takes the low bit) and then the
+  differences between consecutive edges. Each value takes 1 to 4 bytes.
+  The list starts with (d+3)/4 control bytes, one per group of four
+  values, holding the byte length minus one of each value in two bits
+  (value k of the group in bits 2k and 2k+1), followed by the data bytes
+  of all values, little endian and without gaps.
+
+  Because the lengths of a group are in one byte and apart from the data,
+  a group decodes with one 16 byte load and one pshufb through a table
+  indexed by its control byte (SSSE3, which -march=native gives the
+  OPENMP and HOMEGROWN builds); a prefix sum in the register turns the
+  differences into edges. Other builds decode with the scalar loop. The
+  values are 32 bits, so with EDGELONG the differences must still fit
+  in 32 bits (compression aborts on one that does not); the scalar loop
+  is used there.
+
+  A weighted list is 2d values, the target (as above) and then the
+  zigzag coded weight of each edge, and always decodes with the scalar
+  loop. The edges of a vertex are decoded sequentially; par is ignored.
+*/
+
+struct alignas(16) svb_tables {
+  uchar shuffle[256][16]; // gathers the bytes of a group into 4 words
+  uchar length[256];      // data bytes of a group
+};
+
+constexpr svb_tables svbMakeTables() {
+  svb_tables t = {};
+  for (int c = 0; c < 256; c++) {
+    int o = 0;
+    for (int k = 0; k < 4; k++) {
+      int len = ((c >> (2 * k)) & 3) + 1;
+      for (int b = 0; b < 4; b++) t.shuffle[c][4 * k + b] = b < len ? o + b : 0xff;
+      o += len;
+    }
+    t.length[c] = o;
+  }
+  return t;
+}
+
+inline constexpr svb_tables svbTables = svbMakeTables();
+
+inline uintE svbZigzag(intE x) {
+  return ((uintE) x << 1) ^ (x < 0 ? ~(uintE) 0 : 0);
+}
+
+inline intE svbUnzigzag(uint32_t z) {
+  return (intE) (z >> 1) ^ -(intE) (z & 1);
+}
+
+// Reads value j of a list whose data bytes start at data, and advances data.
+inline uint32_t svbGet(const uchar* control, uintT j, uchar* &data) {
+  uint32_t v;
+  switch ((control[j >> 2] >> (2 * (j & 3))) & 3) {
+  case 0: v = data[0]; data += 1; break;
+  case 1: v = data[0] | (uint32_t) data[1] << 8; data += 2; break;
+  case 2: v = data[0] | (uint32_t) data[1] << 8 | (uint32_t) data[2] << 16; data += 3; break;
+  default:
+    v = data[0] | (uint32_t) data[1] << 8 | (uint32_t) data[2] << 16 | (uint32_t) data[3] << 24;
+    data += 4;
+  }
+  return v;
+}
+
+// Writes value j of a list whose control bytes were cleared, and advances data.
+inline void svbPut(uchar* control, uintT j, uintE v, uchar* &data) {
+#if defined(EDGELONG)
+  if (v >> 32) {
+    cout << "STREAMVBYTE: value " << v << " does not fit in 32 bits" << endl;
+    abort();
+  }
+#endif
+  int len = v < (1u << 8) ? 1 : v < (1u << 16) ? 2 : v < (1u << 24) ? 3 : 4;
+  control[j >> 2] |= (len - 1) << (2 * (j & 3));
+  for (int b = 0; b < len; b++) *data++ = v >> (8 * b);
+}
+
+/*
+  Decodes the first group with the scalar loop and the groups after it
+  with pshufb while the 16 byte load stays inside the list, that is while
+  three full groups follow the one being decoded; the scalar loop
+  decodes the rest.
+*/
+template <class T>
+  inline void decode(T t, uchar* edgeStart, const uintE &source, const uintT &degree, const bool par=true) {
+  if (degree == 0) return;
+  const uchar* control = edgeStart;
+  uchar* data = edgeStart + (degree + 3) / 4;
+  uintE edge = source + svbUnzigzag(svbGet(control, 0, data));
+  if (!t.srcTarg(source, edge, 0)) return;
+  uintT edgesRead = 1;
+  for (; edgesRead < 4 && edgesRead < degree; edgesRead++) {
+    edge += svbGet(control, edgesRead, data);
+    if (!t.srcTarg(source, edge, edgesRead)) return;
+  }
+#ifdef STREAMVBYTE_SIMD
+  uintT fullGroups = degree / 4;
+  if (fullGroups > 4) {
+    __m128i prev = _mm_set1_epi32(edge);
+    for (uintT g = 1; g + 3 < fullGroups; g++) {
+      uchar c = control[g];
+      __m128i x = _mm_loadu_si128((const __m128i*) data);
+      x = _mm_shuffle_epi8(x, _mm_load_si128((const __m128i*) svbTables.shuffle[c]));
+      data += svbTables.length[c];
+      x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+      x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+      x = _mm_add_epi32(x, prev);
+      prev = _mm_shuffle_epi32(x, 0xff);
+      uint32_t out[4];
+      _mm_storeu_si128((__m128i*) out, x);
+      for (int k = 0; k < 4; k++)
+        if (!t.srcTarg(source, out[k], edgesRead + k)) return;
+      edgesRead += 4;
+    }
+    edge = (uint32_t) _mm_cvtsi128_si32(prev);
+  }
+#endif
+  for (; edgesRead < degree; edgesRead++) {
+    edge += svbGet(control, edgesRead, data);
+    if (!t.srcTarg(source, edge, edgesRead)) return;
+  }
+}
+
+//decode edges for weighted graph
+template <class T>
+  inline void decodeWgh(T t, uchar* edgeStart, const uintE &source, const uintT &degree, const bool par=true) {
+  if (degree == 0) return;
+  const uchar* control = edgeStart;
+  uchar* data = edgeStart + (2 * degree + 3) / 4;
+  uintE edge = source;
+  for (uintT edgesRead = 0; edgesRead < degree; edgesRead++) {
+    uint32_t v = svbGet(control, 2 * edgesRead, data);
+    if (edgesRead == 0) edge += svbUnzigzag(v);
+    else edge += v;
+    intE weight = svbUnzigzag(svbGet(control, 2 * edgesRead + 1, data));
+    if (!t.srcTarg(source, edge, weight, edgesRead)) return;
+  }
+}
+
+/*
+  Takes:
+    1. The edge array of chars to write into
+    2. The current offset into this array
+    3. The vertices degree
+    4. The vertices vertex number
+    5. The array of saved out-edges we're compressing
+  Returns:
+    The new offset into the edge array
+*/
+long sequentialCompressEdgeSet(uchar *edgeArray, long currentOffset, uintT degree,
+                                uintE vertexNum, uintE *savedEdges) {
+  if (degree > 0) {
+    uchar* control = edgeArray + currentOffset;
+    uchar* data = control + (degree + 3) / 4;
+    memset(control, 0, (degree + 3) / 4);
+    svbPut(control, 0, svbZigzag(savedEdges[0] - vertexNum), data);
+    for (uintT edgeI = 1; edgeI < degree; edgeI++)
+      svbPut(control, edgeI, savedEdges[edgeI] - savedEdges[edgeI - 1], data);
+    currentOffset = data - edgeArray;
+  }
+  return currentOffset;
+}
+
+/*
+  Compresses the edge set in parallel.
+*/
+uintE *parallelCompressEdges(uintE *edges, uintT *offsets, long n, long m, uintE* Degrees) {
+  cout << "parallel compressing, (n,m) = (" << n << "," << m << ")" << endl;
+  uchar **edgePts = newA(uchar*, n);
+  long *charsUsedArr = newA(long, n);
+  long *compressionStarts = newA(long, n+1);
+  {par_for(0, n, 0, [&] (long i) {
+    charsUsedArr[i] = (Degrees[i] + 3) / 4 + 4 * (long) Degrees[i];
+  });}
+  long toAlloc = sequence::plusScan(charsUsedArr,charsUsedArr,n);
+  uchar* iEdges = newA(uchar,toAlloc);
+
+  {par_for(0, n, 0, [&] (long i) {
+      edgePts[i] = iEdges+charsUsedArr[i];
+      charsUsedArr[i] = sequentialCompressEdgeSet(edgePts[i], 0, Degrees[i], i, edges + offsets[i]);
+  });}
+
+  // produce the total space needed for all compressed lists in chars.
+  long totalSpace = sequence::plusScan(charsUsedArr, compressionStarts, n);
+  compressionStarts[n] = totalSpace;
+  free(charsUsedArr);
+
+  uchar *finalArr = newA(uchar, totalSpace);
+  cout << "total space requested is : " << totalSpace << endl;
+  float avgBitsPerEdge = (float)totalSpace*8 / (float)m;
+  cout << "Average bits per edge: " << avgBitsPerEdge << endl;
+
+  {par_for(0, n, 0, [&] (long i) {
+      long o = compressionStarts[i];
+    memcpy(finalArr + o, edgePts[i], compressionStarts[i+1]-o);
+    offsets[i] = o;
+  });}
+  offsets[n] = totalSpace;
+  free(iEdges);
+  free(edgePts);
+  free(compressionStarts);
+  cout << "finished compressing, bytes used = " << totalSpace << endl;
+  cout << "would have been, " << (m * 4) << endl;
+  return ((uintE *)finalArr);
+}
+
+typedef pair<uintE,intE> intEPair;
+
+/*
+  Takes:
+    1. The edge array of chars to write into
+    2. The current offset into this array
+    3. The vertices degree
+    4. The vertices vertex number
+    5. The array of saved out-edges we're compressing
+  Returns:
+    The new offset into the edge array
+*/
+long sequentialCompressWeightedEdgeSet
+(uchar *edgeArray, long currentOffset, uintT degree,
+ uintE vertexNum, intEPair *savedEdges) {
+  if (degree > 0) {
+    uchar* control = edgeArray + currentOffset;
+    uchar* data = control + (2 * degree + 3) / 4;
+    memset(control, 0, (2 * degree + 3) / 4);
+    for (uintT edgeI = 0; edgeI < degree; edgeI++) {
+      uintE v = edgeI == 0 ? svbZigzag(savedEdges[0].first - vertexNum)
+        : savedEdges[edgeI].first - savedEdges[edgeI - 1].first;
+      svbPut(control, 2 * edgeI, v, data);
+      svbPut(control, 2 * edgeI + 1, svbZigzag(savedEdges[edgeI].second), data);
+    }
+    currentOffset = data - edgeArray;
+  }
+  return currentOffset;
+}
+
+/*
+  Compresses the weighted edge set in parallel.
+*/
+uchar *parallelCompressWeightedEdges(intEPair *edges, uintT *offsets, long n, long m, uintE* Degrees) {
+  cout << "parallel compressing, (n,m) = (" << n << "," << m << ")" << endl;
+  uchar **edgePts = newA(uchar*, n);
+  long *charsUsedArr = newA(long, n);
+  long *compressionStarts = newA(long, n+1);
+  {par_for(0, n, 0, [&] (long i) {
+    charsUsedArr[i] = (2 * (long) Degrees[i] + 3) / 4 + 8 * (long) Degrees[i];
+  });}
+  long toAlloc = sequence::plusScan(charsUsedArr,charsUsedArr,n);
+  uchar* iEdges = newA(uchar,toAlloc);
+
+  {par_for(0, n, 0, [&] (long i) {
+    edgePts[i] = iEdges+charsUsedArr[i];
+    charsUsedArr[i] = sequentialCompressWeightedEdgeSet(edgePts[i], 0, Degrees[i], i, edges + offsets[i]);
+  });}
+
+  // produce the total space needed for all compressed lists in chars.
+  long totalSpace = sequence::plusScan(charsUsedArr, compressionStarts, n);
+  compressionStarts[n] = totalSpace;
+  free(charsUsedArr);
+
+  uchar *finalArr = newA(uchar, totalSpace);
+  cout << "total space requested is : " << totalSpace << endl;
+  float avgBitsPerEdge = (float)totalSpace*8 / (float)m;
+  cout << "Average bits per edge: " << avgBitsPerEdge << endl;
+
+  {par_for(0, n, 0, [&] (long i) {
+      long o = compressionStarts[i];
+    memcpy(finalArr + o, edgePts[i], compressionStarts[i+1]-o);
+    offsets[i] = o;
+  });}
+  offsets[n] = totalSpace;
+  free(iEdges);
+  free(edgePts);
+  free(compressionStarts);
+  cout << "finished compressing, bytes used = " << totalSpace << endl;
+  cout << "would have been, " << (m * 8) << endl;
+  return finalArr;
+}
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "mem_stats.h"
+
+// **************************************************************
+//    TIMELINE TRACE (-trace)
+// **************************************************************
+
+// With -trace <file> spans are recorded and written at exit to file in the
+// Chrome trace event format, for chrome://tracing or ui.perfetto.dev. A span
+// is a name and a start and end time on one thread. TRACE_SPAN("name") spans
+// the rest of its scope; trace::phase spans a run of consecutive steps,
+// ending one and starting the next with next(). Every PERF_REGION is also a
+// span. Each thread appends to its own ring buffer of ring_size spans (the
+// oldest are overwritten), so recording a span costs two clock reads and a
+// store; with no -trace it costs one test. Span names must be string
+// literals. With MEM_STATS the spans and phases are also the phases of the
+// memory accounting.
+
+namespace trace {
+
+  struct span_record { const char* name; int64_t start, end; };
+
+  const size_t ring_size = 1 << 16;
+
+  struct ring {
+    long tid;
+    size_t next;
+    span_record spans[ring_size];
+  };
+
+  struct state {
+    bool on;
+    std::string filename;
+    std::chrono::steady_clock::time_point epoch;
+  };
+
+  inline state& current() {
+    static state s = {false, "", std::chrono::steady_clock::now()};
+    return s;
+  }
+
+  inline bool enabled() { return current().on; }
+
+  inline int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - current().epoch).count();
+  }
+
+  inline std::vector<ring*>& rings() {
+    static std::vector<ring*> r;
+    return r;
+  }
+
+  inline ring& local() {
+    static thread_local ring* mine = NULL;
+    if (mine == NULL) {
+      static std::mutex m;
+      std::lock_guard<std::mutex> lk(m);
+      mine = new ring();
+      mine->tid = syscall(SYS_gettid);
+      rings().push_back(mine);
+    }
+    return *mine;
+  }
+
+  inline void record(const char* name, int64_t start, int64_t end) {
+    ring& r = local();
+    r.spans[r.next % ring_size] = span_record{name, start, end};
+    r.next++;
+  }
+
+  // Records a span, or lengthens the thread's last span when it has the
+  // same name and ended less than gap ns before start; loops use it to
+  // merge the chunks a worker runs back to back into one span.
+  inline void extend(const char* name, int64_t start, int64_t end, int64_t gap = 20000) {
+    ring& r = local();
+    if (r.next > 0) {
+      span_record& last = r.spans[(r.next - 1) % ring_size];
+      if (last.name == name && start - last.end < gap) { last.end = end; return; }
+    }
+    record(name, start, end);
+  }
+
+  // Writes the spans of all threads; called at exit.
+  inline void write() {
+    state& s = current();
+    FILE* f = fopen(s.filename.c_str(), "w");
+    if (f == NULL) { perror(s.filename.c_str()); return; }
+    long pid = getpid();
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    size_t dropped = 0;
+    for (size_t t = 0; t < rings().size(); t++) {
+      ring& r = *rings()[t];
+      fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%ld,"
+              "\"args\":{\"name\":\"%s %zu\"}}", first ? "" : ",\n", pid, r.tid,
+              t == 0 ? "main" : "thread", t);
+      first = false;
+      size_t begin = r.next > ring_size ? r.next - ring_size : 0;
+      dropped += begin;
+      for (size_t i = begin; i < r.next; i++) {
+        const span_record& e = r.spans[i % ring_size];
+        fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%ld,\"tid\":%ld,"
+                "\"ts\":%.3f,\"dur\":%.3f}", e.name, pid, r.tid, e.start / 1e3,
+                (e.end - e.start) / 1e3);
+      }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    if (dropped > 0)
+      fprintf(stderr, "trace: %zu oldest spans were overwritten\n", dropped);
+  }
+
+  // Starts tracing to filename; an empty name leaves tracing off.
+  inline void open(const std::string& filename) {
+    if (filename == "") return;
+    state& s = current();
+    s.filename = filename;
+    s.epoch = std::chrono::steady_clock::now();
+    s.on = true;
+    local();  // the main thread is listed first
+    atexit(write);
+  }
+
+  class span {
+    const char* name;
+    int64_t start;
+  public:
+    span(const char* _name) : name(enabled() ? _name : NULL) {
+      if (name != NULL) start = now();
+#ifdef MEM_STATS
+      mem_stats::push(_name);
+#endif
+    }
+    ~span() {
+      if (name != NULL) record(name, start, now());
+#ifdef MEM_STATS
+      mem_stats::pop();
+#endif
+    }
+  };
+
+  class phase {
+    const char* name;
+    int64_t start;
+    bool counted;
+  public:
+    phase(const char* _name) : name(NULL), counted(false) { next(_name); }
+    void next(const char* _name) {
+#ifdef MEM_STATS
+      if (counted) mem_stats::pop();
+      mem_stats::push(_name);
+      counted = true;
+#endif
+      if (!enabled()) return;
+      int64_t t = now();
+      if (name != NULL) record(name, start, t);
+      name = _name; start = t;
+    }
+    ~phase() {
+      if (name != NULL) record(name, start, now());
+#ifdef MEM_STATS
+      if (counted) mem_stats::pop();
+#endif
+    }
+  };
+}
+
+#define TRACE_CAT2(a, b) a##b
+#define TRACE_CAT(a, b) TRACE_CAT2(a, b)
+#define TRACE_SPAN(name) trace::span TRACE_CAT(trace_span_, __LINE__)(name)
+
+#endif
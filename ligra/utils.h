@@ -26,7 +26,11 @@
 #include <iostream>
 #include <fstream>
 #include <stdlib.h>
+#include <cassert>
 #include "parallel.h"
+#include "allocator.h"
+#include "atomic_stats.h"
+#include "access_trace.h"
 using namespace std;
 
 // Needed to make frequent large allocations efficient with standard
@@ -42,7 +46,11 @@ static int __jj =  mallopt(M_TRIM_THRESHOLD,-1);
 typedef unsigned int uint;
 typedef unsigned long ulong;
 
-#define newA(__E,__n) (__E*) malloc((__n)*sizeof(__E))
+#ifdef MEM_STATS
+#define newA(__E,__n) (MEM_NEXT_TAG(MEM_SITE(#__E)), (__E*) allocArray((__n)*sizeof(__E)))
+#else
+#define newA(__E,__n) (__E*) allocArray((__n)*sizeof(__E))
+#endif
 
 template <class E>
 struct identityF { E operator() (const E& x) {return x;}};
@@ -116,11 +124,11 @@ namespace sequence {
     intT _ee = _e;					\
     intT _n = _ee-_ss;					\
     intT _l = nblocks(_n,_bsize);			\
-    parallel_for (intT _i = 0; _i < _l; _i++) {		\
+    par_for (0, _l, 1, [&] (intT _i) {			\
       intT _s = _ss + _i * (_bsize);			\
       intT _e = min(_s + (_bsize), _ee);		\
       _body						\
-	}						\
+	});						\
   }
 
   template <class OT, class intT, class F, class G>
@@ -289,7 +297,7 @@ namespace sequence {
 
   template <class ET, class intT, class PRED>
   intT filter(ET* In, ET* Out, bool* Fl, intT n, PRED p) {
-    parallel_for (intT i=0; i < n; i++) Fl[i] = (bool) p(In[i]);
+    par_for(0, n, 0, [&] (intT i) { Fl[i] = (bool) p(In[i]); });
     intT  m = pack(In, Out, Fl, n);
     return m;
   }
@@ -305,7 +313,7 @@ namespace sequence {
 }
 
 template <class ET>
-inline bool CAS(ET *ptr, ET oldv, ET newv) {
+inline bool rawCAS(ET *ptr, ET oldv, ET newv) {
   if (sizeof(ET) == 1) {
     return __sync_bool_compare_and_swap((bool*)ptr, *((bool*)&oldv), *((bool*)&newv));
   } else if (sizeof(ET) == 4) {
@@ -319,19 +327,58 @@ inline bool CAS(ET *ptr, ET oldv, ET newv) {
   }
 }
 
+// A CAS attempt made on behalf of site; counted in ATOMIC_STATS builds (see
+// atomic_stats.h).
+template <class ET>
+inline bool countedCAS(ET *ptr, ET oldv, ET newv, int site) {
+  ACCESS_ATOMIC(ptr);
+#ifdef ATOMIC_STATS
+  return atomic_stats::attempt(site, ptr, rawCAS(ptr, oldv, newv));
+#else
+  return rawCAS(ptr, oldv, newv);
+#endif
+}
+
+template <class ET>
+inline bool CAS(ET *ptr, ET oldv, ET newv) {
+#ifdef ATOMIC_STATS
+  atomic_stats::call(atomic_stats::SITE_CAS);
+#endif
+  return countedCAS(ptr, oldv, newv, atomic_stats::SITE_CAS);
+}
+
 template <class ET>
 inline bool writeMin(ET *a, ET b) {
+#ifdef ATOMIC_STATS
+  atomic_stats::call(atomic_stats::SITE_WRITEMIN);
+#endif
   ET c; bool r=0;
   do c = *a;
-  while (c > b && !(r=CAS(a,c,b)));
+  while (c > b && !(r=countedCAS(a,c,b,atomic_stats::SITE_WRITEMIN)));
   return r;
 }
 
+// atomically adds b to *a and returns the value it replaced
 template <class ET>
-inline void writeAdd(ET *a, ET b) {
+inline ET writeAdd(ET *a, ET b) {
+#ifdef ATOMIC_STATS
+  atomic_stats::call(atomic_stats::SITE_WRITEADD);
+#endif
   volatile ET newV, oldV;
   do {oldV = *a; newV = oldV + b;}
-  while (!CAS(a, oldV, newV));
+  while (!countedCAS(a, oldV, newV, atomic_stats::SITE_WRITEADD));
+  return oldV;
+}
+
+// atomically do bitwise-OR of *a with b and store in location a
+template <class ET>
+inline void writeOr(ET *a, ET b) {
+#ifdef ATOMIC_STATS
+  atomic_stats::call(atomic_stats::SITE_WRITEOR);
+#endif
+  volatile ET newV, oldV;
+  do {oldV = *a; newV = oldV | b;}
+  while ((oldV != newV) && !countedCAS(a, oldV, newV, atomic_stats::SITE_WRITEOR));
 }
 
 inline uint hashInt(uint a) {
@@ -360,14 +407,14 @@ inline ulong hashInt(ulong a) {
 // UINT_E_MAX.
 template <class G>
 void remDuplicates(G& get_key, uintE* flags, long m, long n) {
-  parallel_for(size_t i=0; i<m; i++) {
+  par_for(0, m, 0, [&] (size_t i) {
     uintE key = get_key(i);
     if(key != UINT_E_MAX && flags[key] == UINT_E_MAX) {
       CAS(&flags[key],(uintE)UINT_E_MAX,static_cast<uintE>(i));
     }
-  }
+  });
   //reset flags
-  parallel_for(size_t i=0; i<m; i++) {
+  par_for(0, m, 0, [&] (size_t i) {
     uintE key = get_key(i);
     if(key != UINT_E_MAX) {
     	if(flags[key] == i) { //win
@@ -376,28 +423,23 @@ void remDuplicates(G& get_key, uintE* flags, long m, long n) {
         get_key(i) = UINT_E_MAX; //lost
       }
     }
-  }
+  });
 }
 
-#if 0
+// Parallel only when _cond holds. Built on par_for, so when it is nested in
+// another parallel loop it runs serially under OPENMP and is spread over idle
+// workers under HOMEGROWN.
 #define granular_for(_i, _start, _end, _cond, _body) { \
   if (_cond) { \
-    {parallel_for(size_t _i=_start; _i < _end; _i++) { \
+    par_for(_start, _end, 0, [&] (size_t _i) { \
       _body \
-    }} \
+    }); \
   } else { \
     {for (size_t _i=_start; _i < _end; _i++) { \
       _body \
     }} \
   } \
   }
-#endif
-
-#define granular_for(_i, _start, _end, _cond, _body) { \
-    {for (size_t _i=_start; _i < _end; _i++) { \
-      _body \
-    }} \
-  }
 
 namespace pbbs {
 
@@ -450,19 +492,13 @@ namespace pbbs {
     // pads in case user wants to allign with cache lines
     size_t line_size = 64;
     size_t bytes = ((n * sizeof(E))/line_size + 1)*line_size;
-#ifndef __APPLE__
-    E* r = (E*) aligned_alloc(line_size, bytes);
-#else
-    E* r;
-    if (posix_memalign((void**)&r, line_size, bytes) != 0) {
-      fprintf(stderr, "Cannot allocate space"); exit(1);
-    }
-#endif
+    MEM_NEXT_TAG("pbbs::new_array");
+    E* r = (E*) allocArray(bytes, line_size);
     if (r == NULL) {fprintf(stderr, "Cannot allocate space"); exit(1);}
     // a hack to make sure tlb is full for huge pages
     if (touch_pages)
-      parallel_for (size_t i = 0; i < bytes; i = i + (1 << 21))
-	((bool*) r)[i] = 0;
+      par_for(0, (bytes + (1 << 21) - 1) >> 21, 0, [&] (size_t p) {
+	((bool*) r)[p << 21] = 0; });
     return r;
   }
 
@@ -472,7 +508,7 @@ namespace pbbs {
     E* r = new_array_no_init<E>(n);
     if (!std::is_trivially_default_constructible<E>::value) {
       if (n > 2048)
-	parallel_for (size_t i = 0; i < n; i++) new ((void*) (r+i)) E;
+	par_for(0, n, 0, [&] (size_t i) { new ((void*) (r+i)) E; });
       else
 	for (size_t i = 0; i < n; i++) new ((void*) (r+i)) E;
     }
@@ -485,7 +521,7 @@ namespace pbbs {
     // C++14 -- suppored by gnu C++11
     if (!std::is_trivially_destructible<E>::value) {
       if (n > 2048)
-	parallel_for (size_t i = 0; i < n; i++) A[i].~E();
+	par_for(0, n, 0, [&] (size_t i) { A[i].~E(); });
       else
 	for (size_t i = 0; i < n; i++) A[i].~E();
     }
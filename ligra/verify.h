@@ -0,0 +1,233 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "parallel.h"
+#include "graph.h"
+#include "pvector.h"
+
+// **************************************************************
+//    RESULT VERIFIERS (-verify)
+// **************************************************************
+
+// With -verify the apps check their result against a serial reference
+// before freeing it, and print one [VERIFY] line:
+//
+//   BFS      - every vertex the serial BFS reaches has a parent one level
+//              closer to the source with an edge to it, the source is its
+//              own parent and the other vertices have none (GAP's check).
+//   PageRank - the L1 distance to a serial PageRank with the same damping,
+//              epsilon and iteration limit is below -verify_tol (1e-6).
+//   Radii    - the radius of every vertex is the largest BFS distance from
+//              the sampled starts that reach it.
+//   BC       - the dependencies of the first source match Brandes' serial
+//              algorithm within a relative -verify_tol on reached vertices.
+//
+// The references run serially and are meant for small graphs. They follow
+// the out-edges of the graph as it was loaded, also while an app holds it
+// transposed, and run on the graph the app ran on, so results of a
+// preprocessed graph are checked in its new ids; a failing vertex is
+// printed in the ids of the input (mapped back through new_ids). Every
+// failure is counted; apps/Benchmark runs one verified run per cell
+// with -verify and reports the cells that fail.
+
+namespace verify {
+
+  inline bool& enabled() {
+    static bool on = false;
+    return on;
+  }
+
+  inline double& tolerance() {
+    static double tol = 1e-6;
+    return tol;
+  }
+
+  inline long& failures() {
+    static long f = 0;
+    return f;
+  }
+
+  // The input id of vertex v.
+  inline long original(pvector<uintE>& new_ids, long v) {
+    if (new_ids[0] == new_ids[1]) return v;
+    for (size_t i = 0; i < new_ids.size(); i++)
+      if (new_ids[i] == (uintE) v) return i;
+    return v;
+  }
+
+  inline void result(const char* app, bool ok, const std::string& detail) {
+    printf("[VERIFY] %s %s%s%s\n", app, ok ? "PASS" : "FAIL", detail == "" ? "" : ": ",
+           detail.c_str());
+    if (!ok) failures()++;
+  }
+
+  // Calls f(w) for the out-neighbors w of v in the graph as loaded.
+  template <class vertex, class F>
+  inline void forOut(graph<vertex>& G, long v, F f) {
+    vertex& x = G.V[v];
+    if (G.transposed) for (uintE j = 0; j < x.getInDegree(); j++) f(x.getInNeighbor(j));
+    else for (uintE j = 0; j < x.getOutDegree(); j++) f(x.getOutNeighbor(j));
+  }
+
+  // Passes the targets a codec decodes to f.
+  template <class F>
+  struct visit {
+    F& f;
+    inline bool srcTarg(const uintE& src, const uintE& target, const uintT& edgeNumber) {
+      f(target);
+      return true;
+    }
+    inline bool srcTarg(const uintE& src, const uintE& target, const intE& weight, const uintT& edgeNumber) {
+      f(target);
+      return true;
+    }
+  };
+
+  template <class F>
+  inline void decodeAll(uchar* edges, long v, uintT degree, F f) {
+#ifndef WEIGHTED
+    decode(visit<F>{f}, edges, v, degree, false);
+#else
+    decodeWgh(visit<F>{f}, edges, v, degree, false);
+#endif
+  }
+
+  // Compressed graphs have no random access to a neighbor; decode the list.
+  template <class F>
+  inline void forOut(graph<compressedSymmetricVertex>& G, long v, F f) {
+    decodeAll(G.V[v].getOutNeighbors(), v, G.V[v].getOutDegree(), f);
+  }
+
+  template <class F>
+  inline void forOut(graph<compressedAsymmetricVertex>& G, long v, F f) {
+    compressedAsymmetricVertex& x = G.V[v];
+    if (G.transposed) decodeAll(x.getInNeighbors(), v, x.getInDegree(), f);
+    else decodeAll(x.getOutNeighbors(), v, x.getOutDegree(), f);
+  }
+
+  // BFS distances from src (-1 where unreached) and the visiting order.
+  template <class vertex>
+  std::vector<long> distances(graph<vertex>& G, long src, std::vector<long>* order = NULL) {
+    std::vector<long> depth(G.n, -1), queue;
+    depth[src] = 0;
+    queue.push_back(src);
+    for (size_t h = 0; h < queue.size(); h++) {
+      long v = queue[h];
+      forOut(G, v, [&] (uintE w) {
+        if (depth[w] == -1) { depth[w] = depth[v] + 1; queue.push_back(w); }
+      });
+    }
+    if (order != NULL) order->swap(queue);
+    return depth;
+  }
+
+  template <class vertex>
+  void bfs(graph<vertex>& G, long src, uintE* Parents, pvector<uintE>& new_ids) {
+    long n = G.n;
+    std::vector<long> depth = distances(G, src);
+    // parentEdge[v]: some edge Parents[v] -> v exists
+    std::vector<bool> parentEdge(n, false);
+    for (long u = 0; u < n; u++)
+      forOut(G, u, [&] (uintE w) { if (Parents[w] == (uintE) u) parentEdge[w] = true; });
+    for (long v = 0; v < n; v++) {
+      std::string bad;
+      uintE p = Parents[v];
+      if (depth[v] == -1) {
+        if (p != UINT_E_MAX) bad = "unreachable vertex has a parent";
+      } else if (v == src) {
+        if (p != (uintE) src) bad = "source is not its own parent";
+      } else if (p == UINT_E_MAX) bad = "reachable vertex has no parent";
+      else if ((long) p >= n || depth[p] != depth[v] - 1) bad = "parent is not one level closer";
+      else if (!parentEdge[v]) bad = "no edge from the parent";
+      if (bad != "") {
+        result("BFS", false, "vertex " + std::to_string(original(new_ids, v)) + ": " + bad);
+        return;
+      }
+    }
+    result("BFS", true, "");
+  }
+
+  template <class vertex>
+  void pagerank(graph<vertex>& G, const double* rank, double damping, double epsilon, long maxIters,
+                pvector<uintE>& new_ids) {
+    long n = G.n;
+    std::vector<double> p(n, 1.0 / n), next(n);
+    for (long iter = 0; iter < maxIters; iter++) {
+      std::fill(next.begin(), next.end(), 0.0);
+      for (long s = 0; s < n; s++) {
+        long deg = 0;
+        forOut(G, s, [&] (uintE) { deg++; });
+        forOut(G, s, [&] (uintE d) { next[d] += p[s] / deg; });
+      }
+      double L1 = 0;
+      for (long v = 0; v < n; v++) {
+        next[v] = damping * next[v] + (1 - damping) / n;
+        L1 += fabs(p[v] - next[v]);
+      }
+      p.swap(next);
+      if (L1 < epsilon) break;
+    }
+    double dist = 0, worst = 0;
+    long worstV = 0;
+    for (long v = 0; v < n; v++) {
+      double d = fabs(rank[v] - p[v]);
+      dist += d;
+      if (d > worst) { worst = d; worstV = v; }
+    }
+    char detail[160];
+    snprintf(detail, sizeof(detail), "L1 distance %.3g to the serial reference (largest %.3g at vertex %ld)",
+             dist, worst, original(new_ids, worstV));
+    result("PageRank", dist <= tolerance(), detail);
+  }
+
+  template <class vertex>
+  void radii(graph<vertex>& G, const std::vector<uintE>& starts, intE* radii, pvector<uintE>& new_ids) {
+    long n = G.n;
+    std::vector<long> ref(n, -1);
+    for (uintE s : starts) {
+      std::vector<long> depth = distances(G, s);
+      for (long v = 0; v < n; v++) ref[v] = std::max(ref[v], depth[v]);
+    }
+    for (long v = 0; v < n; v++)
+      if ((long) radii[v] != ref[v]) {
+        result("Radii", false, "vertex " + std::to_string(original(new_ids, v)) + " has radius " +
+               std::to_string(radii[v]) + ", expected " + std::to_string(ref[v]));
+        return;
+      }
+    result("Radii", true, std::to_string(starts.size()) + " starts");
+  }
+
+  template <class vertex>
+  void bc(graph<vertex>& G, long src, const double* dependencies, pvector<uintE>& new_ids) {
+    long n = G.n;
+    std::vector<long> order;
+    std::vector<long> depth = distances(G, src, &order);
+    std::vector<double> sigma(n, 0), delta(n, 0);
+    sigma[src] = 1;
+    for (long v : order)
+      forOut(G, v, [&] (uintE w) { if (depth[w] == depth[v] + 1) sigma[w] += sigma[v]; });
+    for (long i = order.size() - 1; i >= 0; i--) {
+      long v = order[i];
+      forOut(G, v, [&] (uintE w) {
+        if (depth[w] == depth[v] + 1) delta[v] += sigma[v] / sigma[w] * (1 + delta[w]);
+      });
+    }
+    for (long v : order) {
+      double d = dependencies[v];
+      if (!(fabs(d - delta[v]) <= tolerance() * std::max(1.0, fabs(delta[v])))) {
+        char detail[160];
+        snprintf(detail, sizeof(detail), "vertex %ld has dependency %.10g, expected %.10g",
+                 original(new_ids, v), d, delta[v]);
+        result("BC", false, detail);
+        return;
+      }
+    }
+    result("BC", true, "source " + std::to_string(original(new_ids, src)));
+  }
+}
+
+#endif
@@ -5,6 +5,16 @@ using namespace std;
 
 namespace decode_uncompressed {
 
+  // Address of the j-th out-edge of v, for the access trace.
+  template <class V>
+  inline const void* outEdgeAddr(V* v, long j) {
+#ifndef WEIGHTED
+    return v->getOutNeighbors() + j;
+#else
+    return v->getOutNeighbors() + 2*j;
+#endif
+  }
+
   // Used by edgeMapDense. Callers ensure cond(v_id). For each vertex, decode
   // its in-edges, and check to see whether this neighbor is in the current
   // frontier, calling update if it is. If processing the edges sequentially,
@@ -26,7 +36,7 @@ namespace decode_uncompressed {
         if(!f.cond(v_id)) break;
       }
     } else {
-      parallel_for(size_t j=0; j<d; j++) {
+      par_for(0, d, 0, [&] (size_t j) {
         uintE ngh = v->getInNeighbor(j);
         if (vertexSubset.isIn(ngh)) {
 #ifndef WEIGHTED
@@ -36,7 +46,7 @@ namespace decode_uncompressed {
 #endif
           g(v_id, m);
         }
-      }
+      });
     }
   }
 
@@ -46,6 +56,7 @@ namespace decode_uncompressed {
   inline void decodeOutNgh(V* v, long i, F &f, G &g) {
     uintE d = v->getOutDegree();
     granular_for(j, 0, d, (d > 1000), {
+      ACCESS_READ(outEdgeAddr(v, j));
       uintE ngh = v->getOutNeighbor(j);
       if (f.cond(ngh)) {
 #ifndef WEIGHTED
@@ -64,6 +75,7 @@ namespace decode_uncompressed {
   inline void decodeOutNghSparse(V* v, long i, uintT o, F &f, G &g) {
     uintE d = v->getOutDegree();
     granular_for(j, 0, d, (d > 1000), {
+      ACCESS_READ(outEdgeAddr(v, j));
       uintE ngh = v->getOutNeighbor(j);
       if (f.cond(ngh)) {
 #ifndef WEIGHTED
@@ -120,7 +132,7 @@ namespace decode_uncompressed {
       size_t b_size = 2000;
       size_t blocks = 1 + ((d-1)/b_size);
       auto cts = array_imap<uintE>(blocks, [&] (size_t i) { return 0; });
-      parallel_for_1(size_t i=0; i<blocks; i++) {
+      par_for(0, blocks, 1, [&] (size_t i) {
         size_t s = b_size*i;
         size_t e = std::min(s + b_size, (size_t)d);
         uintE ct = 0;
@@ -134,7 +146,7 @@ namespace decode_uncompressed {
             ct++;
         }
         cts[i] = ct;
-      }
+      });
       size_t count = 0;
       return pbbs::reduce_add(cts);
     }
@@ -172,11 +184,11 @@ namespace decode_uncompressed {
       v->setOutDegree(k);
       return k;
     } else {
-      parallel_for(size_t i=0; i<d; i++) {
+      par_for(0, d, 0, [&] (size_t i) {
         uintE ngh = v->getOutNeighbor(i);
         tmp[i] = ngh;
         bits[i] = p(vtx_id, ngh);
-      }
+      });
       size_t k = sequence::pack(tmp, v->getOutNeighbors(), bits, d);
       v->setOutDegree(k);
       return k;
@@ -94,9 +94,8 @@ struct vertexSubsetData {
   void toDense() {
     if (d == NULL) {
       d = newA(D, n);
-      {parallel_for(long i=0;i<n;i++) std::get<0>(d[i]) = false;}
-      {parallel_for(long i=0;i<m;i++)
-        d[std::get<0>(s[i])] = make_tuple(true, std::get<1>(s[i]));}
+      {par_for(0, n, 0, [&] (long i) { std::get<0>(d[i]) = false; });}
+      {par_for(0, m, 0, [&] (long i) { d[std::get<0>(s[i])] = make_tuple(true, std::get<1>(s[i])); });}
     }
     isDense = true;
   }
@@ -214,8 +213,8 @@ struct vertexSubsetData<pbbs::empty> {
   void toDense() {
     if (d == NULL) {
       d = newA(bool,n);
-      {parallel_for(long i=0;i<n;i++) d[i] = 0;}
-      {parallel_for(long i=0;i<m;i++) d[s[i]] = 1;}
+      {par_for(0, n, 0, [&] (long i) { d[i] = 0; });}
+      {par_for(0, m, 0, [&] (long i) { d[s[i]] = 1; });}
     }
     isDense = true;
   }